@@ -0,0 +1,87 @@
+#include "blob_store.h"
+#include "log.h"
+
+blob_store::blob_store(const char* signature, const char* extension, const char* kind) :_extension(extension), _kind(kind)
+{
+	memcpy(_signature.data(), signature, _signature.size());
+}
+
+bool blob_store::open(const std::filesystem::path& directory)
+{
+	std::error_code error;
+	if (!std::filesystem::exists(directory, error) && !std::filesystem::create_directories(directory, error))
+	{
+		LOG(ERROR) << "Failed to create " << _kind << " directory " << directory.string() << ".\n";
+		_directory.clear();
+		return false;
+	}
+
+	_directory = directory;
+	return true;
+}
+
+void blob_store::close()
+{
+	_directory.clear();
+}
+
+bool blob_store::valid() const
+{
+	return !_directory.empty();
+}
+
+bool blob_store::fetch(const hash128& key, const reader& read) const
+{
+	if (!valid())
+		return false;
+
+	std::ifstream input(entry_path(key), std::ios::binary);
+	if (!input)
+		return false;
+
+	std::array<char, 8> signature = {};
+	input.read(signature.data(), signature.size());
+	if (!input || signature != _signature)
+		return false;
+
+	return read(input);
+}
+
+bool blob_store::store(const hash128& key, const writer& write) const
+{
+	if (!valid())
+		return false;
+
+	const auto path = entry_path(key);
+	auto temp_path = path;
+	temp_path.replace_extension(".tmp");
+
+	{
+		std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+		if (output)
+			output.write(_signature.data(), _signature.size());
+		if (!output || !write(output) || !output)
+		{
+			LOG(ERROR) << "Failed to write " << _kind << " entry " << temp_path.string() << ".\n";
+			output.close();
+			std::error_code error;
+			std::filesystem::remove(temp_path, error);
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temp_path, path, error);
+	if (error)
+	{
+		std::filesystem::remove(temp_path, error);
+		return false;
+	}
+
+	return true;
+}
+
+std::filesystem::path blob_store::entry_path(const hash128& key) const
+{
+	return _directory / (to_string(key) + _extension);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "hash.h"
+
+#include <array>
+#include <functional>
+
+//files in one directory, each named by the digest of everything it was made from
+//an entry starts with the signature of its format and is written aside then renamed, a broken entry is never visible under its key
+class blob_store
+{
+public:
+	using reader = std::function<bool(std::istream&)>;
+	using writer = std::function<bool(std::ostream&)>;
+
+	//signature holds 8 characters, extension includes the dot, kind names the store in the log
+	blob_store(const char* signature, const char* extension, const char* kind);
+	~blob_store() = default;
+
+	bool open(const std::filesystem::path& directory);
+	void close();
+	bool valid() const;
+
+	//read gets the entry after its signature, a missing or differently signed entry fails
+	bool fetch(const hash128& key, const reader& read) const;
+	//write fills the entry after its signature, nothing is stored when it fails
+	bool store(const hash128& key, const writer& write) const;
+
+private:
+	std::filesystem::path entry_path(const hash128& key) const;
+
+	std::array<char, 8> _signature = {};
+	std::string _extension;
+	std::string _kind;
+	std::filesystem::path _directory;
+};
@@ -0,0 +1,250 @@
+#include "composite.h"
+#include "log.h"
+
+#include <random>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define COMPOSITE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	inline uint32_t pack(const RGBQUAD& pixel)
+	{
+		uint32_t value = 0;
+		memcpy(&value, &pixel, sizeof value);
+		return value;
+	}
+
+	//127 alpha black over the background
+	inline RGBQUAD shaded_background(const RGBQUAD& bg)
+	{
+		RGBQUAD shaded = {};
+		shaded.rgbRed = 0 * 127 / 255 + bg.rgbRed * (255 - 127) / 255;
+		shaded.rgbGreen = 0 * 127 / 255 + bg.rgbGreen * (255 - 127) / 255;
+		shaded.rgbBlue = 0 * 127 / 255 + bg.rgbBlue * (255 - 127) / 255;
+		shaded.rgbReserved = 127 + bg.rgbReserved * (255 - 127) / 255;
+		return shaded;
+	}
+
+#ifdef COMPOSITE_SSE2
+	inline __m128i splat(const uint32_t value)
+	{
+		return _mm_set1_epi32(static_cast<int>(value));
+	}
+
+	//lanes without alpha are all ones
+	inline __m128i uncovered(const __m128i pixels)
+	{
+		return _mm_cmpeq_epi32(_mm_and_si128(pixels, splat(0xff000000u)), _mm_setzero_si128());
+	}
+
+	//mask ? a : b
+	inline __m128i select(const __m128i mask, const __m128i a, const __m128i b)
+	{
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	inline __m128i load(const byte* pixels)
+	{
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+	}
+
+	inline void store(byte* pixels, const __m128i value)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels), value);
+	}
+#endif
+}
+
+void composite::reference::shadow_darken(byte* shadow, const size_t count, const RGBQUAD& bg)
+{
+	const RGBQUAD shaded = shaded_background(bg);
+	RGBQUAD* pixels = reinterpret_cast<RGBQUAD*>(shadow);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto& shadowc = pixels[i];
+		if (shadowc.rgbReserved)
+			shadowc = shaded;
+		else
+			shadowc = bg;
+	}
+}
+
+void composite::reference::background_fill(byte* color, const byte* shadow, const size_t count, const RGBQUAD& bg)
+{
+	const RGBQUAD shaded = shaded_background(bg);
+	RGBQUAD* colors = reinterpret_cast<RGBQUAD*>(color);
+	const RGBQUAD* shadows = reinterpret_cast<const RGBQUAD*>(shadow);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto& colorc = colors[i];
+		if (shadows[i].rgbReserved && !colorc.rgbReserved)
+			colorc = shaded;
+		else if (!colorc.rgbReserved)
+			colorc = bg;
+	}
+}
+
+void composite::reference::alpha_over(byte* dst, const byte* src, const size_t count)
+{
+	RGBQUAD* dsts = reinterpret_cast<RGBQUAD*>(dst);
+	const RGBQUAD* srcs = reinterpret_cast<const RGBQUAD*>(src);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (srcs[i].rgbReserved)
+			dsts[i] = srcs[i];
+	}
+}
+
+void composite::reference::half_darken(byte* dst, const byte* shadow, const size_t count)
+{
+	RGBQUAD* dsts = reinterpret_cast<RGBQUAD*>(dst);
+	const RGBQUAD* shadows = reinterpret_cast<const RGBQUAD*>(shadow);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!shadows[i].rgbReserved)
+			continue;
+
+		auto& color = dsts[i];
+		if (color.rgbReserved)
+		{
+			color.rgbRed >>= 1u;
+			color.rgbGreen >>= 1u;
+			color.rgbBlue >>= 1u;
+		}
+		else
+		{
+			color = { 0u,0u,0u,127u };
+		}
+	}
+}
+
+void composite::shadow_darken(byte* shadow, const size_t count, const RGBQUAD& bg)
+{
+	size_t i = 0;
+#ifdef COMPOSITE_SSE2
+	const __m128i shaded = splat(pack(shaded_background(bg)));
+	const __m128i plain = splat(pack(bg));
+
+	for (; i + 4u <= count; i += 4u)
+	{
+		const __m128i pixels = load(shadow + i * 4u);
+		store(shadow + i * 4u, select(uncovered(pixels), plain, shaded));
+	}
+#endif
+	reference::shadow_darken(shadow + i * 4u, count - i, bg);
+}
+
+void composite::background_fill(byte* color, const byte* shadow, const size_t count, const RGBQUAD& bg)
+{
+	size_t i = 0;
+#ifdef COMPOSITE_SSE2
+	const __m128i shaded = splat(pack(shaded_background(bg)));
+	const __m128i plain = splat(pack(bg));
+
+	for (; i + 4u <= count; i += 4u)
+	{
+		const __m128i colors = load(color + i * 4u);
+		const __m128i fill = select(uncovered(load(shadow + i * 4u)), plain, shaded);
+		store(color + i * 4u, select(uncovered(colors), fill, colors));
+	}
+#endif
+	reference::background_fill(color + i * 4u, shadow + i * 4u, count - i, bg);
+}
+
+void composite::alpha_over(byte* dst, const byte* src, const size_t count)
+{
+	size_t i = 0;
+#ifdef COMPOSITE_SSE2
+	for (; i + 4u <= count; i += 4u)
+	{
+		const __m128i srcs = load(src + i * 4u);
+		store(dst + i * 4u, select(uncovered(srcs), load(dst + i * 4u), srcs));
+	}
+#endif
+	reference::alpha_over(dst + i * 4u, src + i * 4u, count - i);
+}
+
+void composite::half_darken(byte* dst, const byte* shadow, const size_t count)
+{
+	size_t i = 0;
+#ifdef COMPOSITE_SSE2
+	const __m128i alpha_mask = splat(0xff000000u);
+	const __m128i half_black = splat(0x7f000000u);
+
+	for (; i + 4u <= count; i += 4u)
+	{
+		const __m128i dsts = load(dst + i * 4u);
+		//shifting the whole lane moves the low bit of the next channel in, masked off per byte
+		const __m128i halved = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(dsts, 1), splat(0x007f7f7fu)), _mm_and_si128(dsts, alpha_mask));
+		const __m128i darkened = select(uncovered(dsts), half_black, halved);
+		store(dst + i * 4u, select(uncovered(load(shadow + i * 4u)), dsts, darkened));
+	}
+#endif
+	reference::half_darken(dst + i * 4u, shadow + i * 4u, count - i);
+}
+
+bool composite::self_check()
+{
+	std::mt19937 engine(0x5eed);
+	std::uniform_int_distribution<uint32_t> channel(0u, 255u);
+
+	const auto random_pixels = [&](const size_t count) {
+		std::vector<byte> pixels(count * 4u);
+		for (size_t i = 0; i < pixels.size(); i++)
+			pixels[i] = static_cast<byte>(channel(engine));
+		//half of the pixels are transparent
+		for (size_t i = 0; i < count; i++)
+			if (channel(engine) & 1u)
+				pixels[i * 4u + 3u] = 0;
+		return pixels;
+	};
+
+	bool passed = true;
+	const auto expect_equal = [&passed](const std::vector<byte>& result, const std::vector<byte>& expected, const char* kernel, const size_t count) {
+		if (result != expected)
+		{
+			LOG(ERROR) << "Compositing kernel " << kernel << " differs from the reference, " << count << " pixels.\n";
+			passed = false;
+		}
+	};
+
+	for (size_t count = 0; count <= 67u; count++)
+	{
+		const auto shadow = random_pixels(count);
+		const auto color = random_pixels(count);
+		RGBQUAD bg = {};
+		bg.rgbRed = static_cast<BYTE>(channel(engine));
+		bg.rgbGreen = static_cast<BYTE>(channel(engine));
+		bg.rgbBlue = static_cast<BYTE>(channel(engine));
+		bg.rgbReserved = (count & 1u) ? static_cast<BYTE>(channel(engine)) : 0u;
+
+		auto result = shadow, expected = shadow;
+		shadow_darken(result.data(), count, bg);
+		reference::shadow_darken(expected.data(), count, bg);
+		expect_equal(result, expected, "shadow_darken", count);
+
+		result = expected = color;
+		background_fill(result.data(), shadow.data(), count, bg);
+		reference::background_fill(expected.data(), shadow.data(), count, bg);
+		expect_equal(result, expected, "background_fill", count);
+
+		result = expected = color;
+		alpha_over(result.data(), shadow.data(), count);
+		reference::alpha_over(expected.data(), shadow.data(), count);
+		expect_equal(result, expected, "alpha_over", count);
+
+		result = expected = color;
+		half_darken(result.data(), shadow.data(), count);
+		reference::half_darken(expected.data(), shadow.data(), count);
+		expect_equal(result, expected, "half_darken", count);
+	}
+
+	return passed;
+}
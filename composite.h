@@ -0,0 +1,29 @@
+#pragma once
+
+#include "general_headers.h"
+
+//compositing kernels for exported frames
+//pixels are 4 bytes in RGBQUAD order with the alpha in the last byte, a pixel is covered when its alpha is not 0
+namespace composite
+{
+	//standalone shadow: covered pixels become the background under half transparent black, the rest the background
+	void shadow_darken(byte* shadow, const size_t count, const RGBQUAD& bg);
+	//integrated shadow: transparent color pixels take the shadowed or the plain background
+	void background_fill(byte* color, const byte* shadow, const size_t count, const RGBQUAD& bg);
+	//covered source pixels replace the destination
+	void alpha_over(byte* dst, const byte* src, const size_t count);
+	//under the shadow covered pixels are halved, transparent ones become half transparent black
+	void half_darken(byte* dst, const byte* shadow, const size_t count);
+
+	//one pixel at a time, the results of the kernels above must match these bit by bit
+	namespace reference
+	{
+		void shadow_darken(byte* shadow, const size_t count, const RGBQUAD& bg);
+		void background_fill(byte* color, const byte* shadow, const size_t count, const RGBQUAD& bg);
+		void alpha_over(byte* dst, const byte* src, const size_t count);
+		void half_darken(byte* dst, const byte* shadow, const size_t count);
+	}
+
+	//runs the kernels against the references on random pixels, errors are logged
+	bool self_check();
+}
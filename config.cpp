@@ -1,6 +1,64 @@
 #include "config.h"
 
-#include <filesystem>
+#include <bit>
+#include <charconv>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define CONFIG_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    template<typename filter>
+    std::string_view trim(const std::string_view string, filter&& skipped)
+    {
+        const char* first = string.data();
+        const char* last = first + string.size();
+        while (first < last && skipped(*first))
+            first++;
+        while (last > first && skipped(*(last - 1)))
+            last--;
+        return std::string_view(first, last - first);
+    }
+
+    bool is_space(const char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    std::string_view trim(const std::string_view string)
+    {
+        return trim(string, is_space);
+    }
+
+    bool is_special(const char c)
+    {
+        return c == '\n' || c == ';' || c == '/' || c == '=' || c == ',';
+    }
+
+    //bit i is set when block[i] may change the parse state
+    uint32_t special_chars(const char* block, const size_t size)
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < size; i++)
+            mask |= static_cast<uint32_t>(is_special(block[i])) << i;
+        return mask;
+    }
+
+    uint32_t special_chars(const char* block)
+    {
+#ifdef CONFIG_SSE2
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        const __m128i breaks = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(';')));
+        const __m128i slashes = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('/')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('=')));
+        const __m128i special = _mm_or_si128(_mm_or_si128(breaks, slashes), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(',')));
+        return static_cast<uint32_t>(_mm_movemask_epi8(special));
+#else
+        return special_chars(block, 16);
+#endif
+    }
+}
 
 config::config(const std::string& filename)
 {
@@ -9,266 +67,462 @@ config::config(const std::string& filename)
 
 bool config::load(const std::string& filename)
 {
-    //char linebuff[0x200]{ 0 };
-    std::ifstream file(filename);
+    clear();
 
-    if (!file)
+    //a missing file is not an error, optional configs are loaded the same way
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(filename, error))
         return false;
 
-    std::string current_section, filestring;
-    size_t filesize = std::filesystem::file_size(filename);
-    filestring.resize(filesize);
-    file.read(filestring.data(), filesize);
-    *(filestring.end() - 1) = 0;
-    size_t off = 0;
-    std::string key;
-    while (getline(filestring, off, key))
+    const uintmax_t filesize = std::filesystem::file_size(filename, error);
+    if (error || !filesize)
+        return false;
+
+    std::string_view text;
+    if (filesize < mapping_threshold)
     {
-        if (is_annotation(key) || is_empty(key))
-            continue;
+        std::ifstream file(filename, std::ios::binary);
+        _text.resize(static_cast<size_t>(filesize));
+        if (!file.read(_text.data(), _text.size()))
+        {
+            _text.clear();
+            return false;
+        }
+        text = _text;
+    }
+    else
+    {
+        if (!_file.open(filename))
+            return false;
+        text = std::string_view(reinterpret_cast<const char*>(_file.data()), _file.size());
+    }
+
+    if (text.substr(0, 3) == "\xEF\xBB\xBF")
+        text.remove_prefix(3);
+
+    return parse(text);
+}
 
-        remove_annotation(key);
+bool config::parse(const std::string_view text)
+{
+    //values are spans into _values, they are resolved once it stops growing
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t current = npos;
+
+    //rough guesses from ordinary ini files, lines average about 24 bytes
+    ranges.reserve(text.size() / 24);
+    _pairs.reserve(ranges.capacity());
+    _key_hashes.reserve(ranges.capacity());
+    _values.reserve(text.size() / 16);
+
+    //the line being swept, an annotation sets content_end and hides the rest of the line
+    const char* line = text.data();
+    const char* content_end = nullptr;
+    const char* equal = nullptr;
+    const char* value_start = nullptr;
+    size_t first = 0;
+
+    auto push_value = [&](const char* value_end) {
+        //splitting stops at the first empty value
+        const std::string_view value = trim(std::string_view(value_start, value_end - value_start));
+        value_start = value.empty() ? nullptr : value_end + 1;
+        if (!value.empty())
+            _values.push_back(value);
+    };
+
+    auto add_line = [&](const char* eol) {
+        if (!content_end)
+            content_end = eol;
+        if (value_start)
+            push_value(content_end);
+
+        //a repeated section starts over
+        const std::string_view content = trim(std::string_view(line, content_end - line));
+        if (!content.empty() && content.front() == '[' && content.back() == ']')
+        {
+            _values.resize(first);
+            const std::string_view name = trim(content, [](const char c) { return is_space(c) || c == '[' || c == ']'; });
+            current = _sections.size();
+            _sections.push_back({ name,string_hash()(name),_pairs.size(),0 });
+            return;
+        }
 
-        if (is_section(key))
+        const std::string_view key = equal ? trim(std::string_view(line, equal - 1 - line)) : std::string_view();
+        const size_t count = _values.size() - first;
+        if (!count || key.empty())
         {
-            current_section = key;
-            convert_section_name(current_section);
-            _config[current_section] = section_type();
+            _values.resize(first);
+            return;
+        }
+
+        if (current == npos)
+        {
+            current = _sections.size();
+            _sections.push_back({ std::string_view(),string_hash()(std::string_view()),_pairs.size(),0 });
+        }
+
+        _pairs.emplace_back(key, value_type());
+        _key_hashes.push_back(string_hash()(key));
+        ranges.emplace_back(first, count);
+        _sections[current].count++;
+    };
+
+    //only line breaks, annotations, '=' and ',' are visited, the blocks find them 16 bytes at a time
+    const char* const data = text.data();
+    const size_t size = text.size();
+    for (size_t block = 0; block < size; block += 16)
+    {
+        uint32_t mask = block + 16 <= size ? special_chars(data + block) : special_chars(data + block, size - block);
+        while (mask)
+        {
+            const char* c = data + block + std::countr_zero(mask);
+            mask &= mask - 1;
+
+            if (*c == '\n')
+            {
+                add_line(c);
+                line = c + 1;
+                content_end = equal = value_start = nullptr;
+                first = _values.size();
+                continue;
+            }
+
+            if (content_end)
+                continue;
+
+            if (*c == ';' || (*c == '/' && c + 1 < data + size && c[1] == '/'))
+                content_end = c;
+            else if (*c == '=' && !equal)
+                equal = value_start = c + 1;
+            else if (*c == ',' && value_start)
+                push_value(c);
+        }
+    }
+
+    if (line < data + size)
+        add_line(data + size);
+
+    merge_keys(ranges);
+    for (size_t i = 0; i < _pairs.size(); i++)
+        _pairs[i].second = value_type(_values.data() + ranges[i].first, ranges[i].second);
+
+    //a repeated section starts over, so only its last block is kept
+    std::stable_sort(_sections.begin(), _sections.end(), [](const section_data& l, const section_data& r) {
+        return l.hash < r.hash;
+    });
+
+    size_t kept = 0;
+    for (size_t i = 0; i < _sections.size(); i++)
+    {
+        const bool repeated = i + 1 < _sections.size() && _sections[i + 1].hash == _sections[i].hash && _sections[i + 1].name == _sections[i].name;
+        if (!repeated)
+            _sections[kept++] = _sections[i];
+    }
+    _sections.resize(kept);
+
+    return is_loaded();
+}
+
+void config::merge_keys(std::vector<std::pair<size_t, size_t>>& ranges)
+{
+    //a repeated key keeps its first place and takes the values of the last one, a merged key is left without values
+    bool merged = false;
+    auto merge = [&](const size_t key, const size_t later) {
+        if (!ranges[later].second || _pairs[later].first != _pairs[key].first)
+            return;
+
+        ranges[key] = ranges[later];
+        ranges[later].second = 0;
+        merged = true;
+    };
+
+    auto by_hash = [this](const size_t l, const size_t r) {
+        return _key_hashes[l] < _key_hashes[r] || (_key_hashes[l] == _key_hashes[r] && l < r);
+    };
+
+    _key_order.clear();
+    for (section_data& section : _sections)
+    {
+        const size_t first = section.first;
+        const size_t last = first + section.count;
+        if (section.count <= scanned_section_size)
+        {
+            for (size_t key = first; key < last; key++)
+            {
+                for (size_t later = key + 1; later < last && ranges[key].second; later++)
+                {
+                    if (_key_hashes[later] == _key_hashes[key])
+                        merge(key, later);
+                }
+            }
             continue;
         }
 
-        std::string right = split(key);
-        value_type values = split_values(right);
+        //large sections keep their keys sorted by hash, equal keys end up next to each other
+        section.sorted = _key_order.size();
+        for (size_t i = first; i < last; i++)
+            _key_order.push_back(i);
+
+        const auto begin = _key_order.begin() + section.sorted;
+        const auto end = _key_order.end();
+        std::sort(begin, end, by_hash);
+        for (auto key = begin; key != end; key++)
+        {
+            for (auto later = key + 1; later != end && ranges[*key].second && _key_hashes[*later] == _key_hashes[*key]; later++)
+                merge(*key, *later);
+        }
+    }
+
+    if (!merged)
+        return;
+
+    //sections were added in file order, so are their keys and sorted blocks, the merged keys are dropped in place
+    std::vector<size_t> moved(_pairs.size(), npos);
+    size_t kept = 0, sorted = 0;
+    for (section_data& section : _sections)
+    {
+        const size_t first = section.first;
+        const size_t count = section.count;
+        section.first = kept;
+        for (size_t i = first; i < first + count; i++)
+        {
+            if (!ranges[i].second)
+                continue;
+
+            moved[i] = kept;
+            _pairs[kept] = _pairs[i];
+            _key_hashes[kept] = _key_hashes[i];
+            ranges[kept] = ranges[i];
+            kept++;
+        }
+        section.count = kept - section.first;
 
-        if (values.empty() || key.empty())
+        if (section.sorted == npos)
             continue;
 
-        _config[current_section][key] = values;
+        const size_t block = section.sorted;
+        section.sorted = sorted;
+        for (size_t i = block; i < block + count; i++)
+        {
+            if (moved[_key_order[i]] != npos)
+                _key_order[sorted++] = moved[_key_order[i]];
+        }
     }
 
-    return is_loaded();
+    _pairs.resize(kept);
+    _key_hashes.resize(kept);
+    _key_order.resize(sorted);
+    ranges.resize(kept);
+}
+
+size_t config::find_key(const section_data& section, const std::string_view key) const
+{
+    const size_t hash = string_hash()(key);
+    if (section.sorted == npos)
+    {
+        for (size_t i = section.first; i < section.first + section.count; i++)
+        {
+            if (_key_hashes[i] == hash && _pairs[i].first == key)
+                return i;
+        }
+
+        return npos;
+    }
+
+    const auto begin = _key_order.begin() + section.sorted;
+    const auto end = begin + section.count;
+    auto iter = std::lower_bound(begin, end, hash, [this](const size_t i, const size_t hash) {
+        return _key_hashes[i] < hash;
+    });
+
+    for (; iter != end && _key_hashes[*iter] == hash; iter++)
+    {
+        if (_pairs[*iter].first == key)
+            return *iter;
+    }
+
+    return npos;
+}
+
+const config::section_data* config::find_section(const std::string_view name) const
+{
+    const size_t hash = string_hash()(name);
+    auto iter = std::lower_bound(_sections.begin(), _sections.end(), hash, [](const section_data& section, const size_t hash) {
+        return section.hash < hash;
+    });
+
+    for (; iter != _sections.end() && iter->hash == hash; iter++)
+    {
+        if (iter->name == name)
+            return &*iter;
+    }
+
+    return nullptr;
 }
 
 bool config::is_loaded() const
 {
-    return !_config.empty();
+    return !_sections.empty();
 }
 
 void config::clear()
 {
-    _config.clear();
+    _sections.clear();
+    _pairs.clear();
+    _key_hashes.clear();
+    _key_order.clear();
+    _values.clear();
+    _file.close();
+    _text.clear();
 }
 
-config::section_type config::operator[](const std::string& name)
+config::section_type config::operator[](const std::string_view name) const
 {
     return section(name);
 }
 
-config::section_type config::section(const std::string& name)
+config::section_type config::section(const std::string_view name) const
 {
-    section_type section;
-
-    config_type::const_iterator iter = _config.find(name);
-    if (iter == _config.end())
-        return section;
-    return iter->second;
+    const section_data* sec = find_section(name);
+    if (!sec)
+        return section_type();
+    return section_type(_pairs.data() + sec->first, sec->count);
 }
 
-config::value_type config::value(const std::string& secname, const std::string& key)
+config::value_type config::value(const std::string_view secname, const std::string_view key) const
 {
-    value_type values;
-    section_type sec = section(secname);
-
-    if (sec.empty())
-        return values;
-
-    section_type::const_iterator iter = sec.find(key);
-    if (iter == sec.end())
-        return values;
-    return iter->second;
+    const section_data* sec = find_section(secname);
+    if (!sec)
+        return value_type();
+
+    const size_t idx = find_key(*sec, key);
+    if (idx == npos)
+        return value_type();
+    return _pairs[idx].second;
 }
 
-std::vector<int> config::value_as_int(const std::string& section, const std::string& key)
+std::vector<int> config::value_as_int(const std::string_view section, const std::string_view key) const
 {
     std::vector<int> ret;
-    value_type values = value(section, key);
-
-    ret.resize(values.size());
-    for (size_t i = 0; i < ret.size(); i++)
-    {
-        ret[i] = atoi(values[i].c_str());
-    }
+    for (const auto value : value(section, key))
+        ret.push_back(to_int(value));
 
     return ret;
 }
 
-std::vector<bool> config::value_as_bool(const std::string& section, const std::string& key, bool def)
+std::vector<bool> config::value_as_bool(const std::string_view section, const std::string_view key, bool def) const
 {
     std::vector<bool> ret;
-    value_type values = value(section, key);
-
-    for (std::string value : values)
-    {
-        char first = std::toupper(value.front());
-        if (first == 'T' || first == 'Y' || first == '1')
-            ret.push_back(true);
-        else if (first == 'F' || first == 'N' || first == '0')
-            ret.push_back(false);
-        else
-            ret.push_back(def);
-    }
+    for (const auto value : value(section, key))
+        ret.push_back(to_bool(value, def));
 
     return ret;
 }
 
-std::vector<double> config::value_as_double(const std::string& section, const std::string& key)
+std::vector<double> config::value_as_double(const std::string_view section, const std::string_view key) const
 {
     std::vector<double> ret;
-    value_type values = value(section, key);
-
-    ret.resize(values.size());
-    for (size_t i = 0; i < ret.size(); i++)
-    {
-        ret[i] = atof(values[i].c_str());
-    }
+    for (const auto value : value(section, key))
+        ret.push_back(to_double(value));
 
     return ret;
 }
 
-std::vector<std::string> config::value_as_strings(const std::string& section, const std::string& key)
+std::vector<std::string> config::value_as_strings(const std::string_view section, const std::string_view key) const
 {
-    return value(section, key);
+    const value_type values = value(section, key);
+    return std::vector<std::string>(values.begin(), values.end());
 }
 
-int config::read_int(const std::string& section, const std::string& key, int def)
+int config::read_int(const std::string_view section, const std::string_view key, int def) const
 {
-    std::vector<int> values = value_as_int(section, key);
+    const value_type values = value(section, key);
     if (values.empty())
         return def;
-    return values.front();
+    return to_int(values.front(), def);
 }
 
-bool config::read_bool(const std::string& section, const std::string& key, bool def)
+bool config::read_bool(const std::string_view section, const std::string_view key, bool def) const
 {
-    std::vector<bool> values = value_as_bool(section, key, def);
+    const value_type values = value(section, key);
     if (values.empty())
         return def;
-    return values.front();
+    return to_bool(values.front(), def);
 }
 
-std::string config::read_string(const std::string& section, const std::string& key, std::string def)
+double config::read_double(const std::string_view section, const std::string_view key, double def) const
 {
-    value_type values = value(section, key);
-    if (values.empty() || values.front().empty())
+    const value_type values = value(section, key);
+    if (values.empty())
         return def;
-    return values.front();
+    return to_double(values.front(), def);
 }
 
-void config::trim(std::string& string, const char* filter)
+std::string config::read_string(const std::string_view section, const std::string_view key, const std::string_view def) const
 {
-    string.erase(0, string.find_first_not_of(filter));
-    string.erase(string.find_last_not_of(filter) + 1);//std::string::npos + 1 == 0;
-    string.erase(string.find_last_not_of('\0') + 1);//std::string::npos + 1 == 0;
+    const value_type values = value(section, key);
+    if (values.empty() || values.front().empty())
+        return std::string(def);
+    return std::string(values.front());
 }
 
-void config::remove_annotation(std::string& string)
+int config::to_int(const std::string_view string, int def)
 {
-    if (string.find(';') != string.npos)
-        string.erase(string.find(';'));
-
-    if (string.find("//") != string.npos)
-        string.erase(string.find("//"));
+    parse(string, def);
+    return def;
 }
 
-std::string config::split(std::string& string, char delim)
+bool config::to_bool(const std::string_view string, bool def)
 {
-    std::string right;
-
-    if (string.find(delim) != string.npos)
-    {
-        right = string;
-        string.erase(string.find(delim));
-        trim(string);
-
-        right.erase(0, right.find(delim) + 1);
-        trim(right);
-    }
-
-    return right;
+    parse(string, def);
+    return def;
 }
 
-config::value_type config::split_values(const std::string& string)
+double config::to_double(const std::string_view string, double def)
 {
-    std::vector<std::string> values;
-    std::string current;
-    size_t current_off;
-    size_t string_off;
-
-    string_off = 0;
-    current_off = string.find(',');
-    current.assign(string, string_off, current_off);
-    trim(current);
-
-    while (!current.empty())
-    {
-        values.push_back(current);
-        if (current_off == std::string::npos)
-            break;
-
-        string_off = current_off + 1;
-        current_off = string.find(',', current_off + 1);
-        current.assign(string, string_off, current_off - string_off);
-        trim(current);
-    }
-
-    return values;
+    parse(string, def);
+    return def;
 }
 
-bool config::is_section(const std::string& string)
+bool config::parse(std::string_view string, int& result)
 {
-    std::string copy = string;
+    //from_chars does not take the sign atoi accepted
+    if (!string.empty() && string.front() == '+')
+        string.remove_prefix(1);
+
+    int value = 0;
+    if (std::from_chars(string.data(), string.data() + string.size(), value).ec != std::errc())
+        return false;
 
-    trim(copy);
-    return !copy.empty() && copy.front() == '[' && copy.back() == ']' && copy.find(';') == std::string::npos;
+    result = value;
+    return true;
 }
 
-bool config::is_empty(const std::string string)
+bool config::parse(const std::string_view string, bool& result)
 {
-    std::string copy = string;
+    if (string.empty())
+        return false;
 
-    trim(copy);
-    return copy.empty();
-}
+    const char first = static_cast<char>(std::toupper(static_cast<unsigned char>(string.front())));
+    if (first == 'T' || first == 'Y' || first == '1')
+        result = true;
+    else if (first == 'F' || first == 'N' || first == '0')
+        result = false;
+    else
+        return false;
 
-void config::convert_section_name(std::string& string)
-{
-    trim(string, " \t\r\n;[]");
+    return true;
 }
 
-bool config::is_annotation(const std::string& string)
+bool config::parse(std::string_view string, double& result)
 {
-    std::string copy = string;
-    trim(copy, " \t\r\n");
+    if (!string.empty() && string.front() == '+')
+        string.remove_prefix(1);
 
-    return !copy.empty() && (copy.front() == ';' || copy.substr(0, 2) == "//");
-}
-bool config::getline(const std::string& filestring, size_t& off, std::string& result)
-{
-    if (filestring.length() <= off)
+    double value = 0.0;
+    if (std::from_chars(string.data(), string.data() + string.size(), value).ec != std::errc())
         return false;
 
-    if (size_t retpos = filestring.find('\n', off); retpos != filestring.npos) {
-        result.assign(filestring.begin() + off, filestring.begin() + retpos);
-        off = retpos + 1;
-
-        return true;
-    }
-    else
-    {
-        result.assign(filestring.begin() + off, filestring.end());
-        off = filestring.npos;
-        return !result.empty();
-    }
-
-    return false;
+    result = value;
+    return true;
 }
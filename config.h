@@ -1,49 +1,101 @@
 #pragma once
 
 #include "filedefinitions.h"
+#include "mapped_file.h"
 
-//read only config
+#include <span>
+#include <string_view>
+
+//lets string keyed maps be searched with any string type without building a std::string
+struct string_hash
+{
+	using is_transparent = void;
+
+	size_t operator()(const std::string_view string) const
+	{
+		return std::hash<std::string_view>()(string);
+	}
+};
+
+//read only config, names and values are views into the loaded text
+//small files are copied and closed, only large ones like rules stay mapped and locked while loaded
 class config
 {
 public:
-	using value_type = std::vector<std::string>;						//a value consists of multiple splited values
-	using section_type = std::unordered_map<std::string, value_type>;	//a section contains multiple key-value pairs
-	using config_type = std::unordered_map<std::string, section_type>;	//a config contains multiple sections
+	using value_type = std::span<const std::string_view>;			//a value consists of multiple splited values
+	using pair_type = std::pair<std::string_view, value_type>;
+	using section_type = std::span<const pair_type>;				//a section contains multiple key-value pairs, in file order
 
 	config() = default;
 	~config() = default;
 	config(const std::string& filename);
 
+	//the views point into this object
+	config(const config&) = delete;
+	config& operator=(const config&) = delete;
+
 	//
 	bool load(const std::string& filename);
 	bool is_loaded() const;
 	void clear();
 
-	//
-	section_type operator[](const std::string& section);
-	section_type section(const std::string& name);
-	value_type value(const std::string& section, const std::string& key);
-
-	std::vector<int> value_as_int(const std::string& section, const std::string& key);
-	std::vector<bool> value_as_bool(const std::string& section, const std::string& key, bool def);
-	std::vector<double> value_as_double(const std::string& section, const std::string& key);
-	std::vector<std::string> value_as_strings(const std::string& section, const std::string& key);
-
-	int read_int(const std::string& section, const std::string& key, int def);
-	bool read_bool(const std::string& section, const std::string& key, bool def);
-	std::string read_string(const std::string& section, const std::string& key, std::string def);
-
-	//private:
-	static void trim(std::string& string, const char* filter = " \t\r\n");
-	static void remove_annotation(std::string& string);
-	static std::string split(std::string& left, char delim = '=');
-	static value_type split_values(const std::string& string);
-	static bool is_section(const std::string& string);
-	static bool is_empty(const std::string string);
-	static void convert_section_name(std::string& string);
-	static bool is_annotation(const std::string& string);
-	static bool getline(const std::string& filestring, size_t& off, std::string& result);
-
-	config_type _config;
+	//the returned spans stay valid until the config is cleared or reloaded
+	section_type operator[](const std::string_view section) const;
+	section_type section(const std::string_view name) const;
+	value_type value(const std::string_view section, const std::string_view key) const;
+
+	std::vector<int> value_as_int(const std::string_view section, const std::string_view key) const;
+	std::vector<bool> value_as_bool(const std::string_view section, const std::string_view key, bool def) const;
+	std::vector<double> value_as_double(const std::string_view section, const std::string_view key) const;
+	std::vector<std::string> value_as_strings(const std::string_view section, const std::string_view key) const;
+
+	//first value of a key, nothing is allocated except the returned string
+	int read_int(const std::string_view section, const std::string_view key, int def) const;
+	bool read_bool(const std::string_view section, const std::string_view key, bool def) const;
+	double read_double(const std::string_view section, const std::string_view key, double def) const;
+	std::string read_string(const std::string_view section, const std::string_view key, const std::string_view def) const;
+
+	//single value conversions, def is returned for text that is not a number or a boolean
+	static int to_int(const std::string_view string, int def = 0);
+	static bool to_bool(const std::string_view string, bool def);
+	static double to_double(const std::string_view string, double def = 0.0);
+
+	//false leaves the result untouched
+	static bool parse(std::string_view string, int& result);
+	static bool parse(const std::string_view string, bool& result);
+	static bool parse(std::string_view string, double& result);
+
+private:
+	//keys of a section are contiguous in _pairs, a later duplicate key replaces the values
+	//_key_order holds the keys of large sections sorted by hash
+	struct section_data
+	{
+		std::string_view name;
+		size_t hash = 0;
+		size_t first = 0;
+		size_t count = 0;
+		//where the keys start in _key_order, short sections are scanned and have none
+		size_t sorted = static_cast<size_t>(-1);
+	};
+
+	static constexpr const size_t npos = static_cast<size_t>(-1);
+	static constexpr const size_t scanned_section_size = 16;
+	static constexpr const uintmax_t mapping_threshold = 256u * 1024u;
+
+	//one sweep per line, the text has to outlive the config
+	bool parse(const std::string_view text);
+	//repeated keys are merged after the sweep, one sort per section instead of a scan per key
+	void merge_keys(std::vector<std::pair<size_t, size_t>>& ranges);
+	size_t find_key(const section_data& section, const std::string_view key) const;
+	const section_data* find_section(const std::string_view name) const;
+
+	mapped_file _file;
+	std::string _text;
+	std::vector<std::string_view> _values;
+	std::vector<pair_type> _pairs;
+	std::vector<size_t> _key_hashes;
+	std::vector<size_t> _key_order;
+	//sorted by hash once loaded
+	std::vector<section_data> _sections;
 };
 
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "config.h"
+
+#include <array>
+#include <functional>
+#include <optional>
+
+//binds the keys of one ini section to the fields of a settings struct
+//the schema is built once, applying it converts every value once and leaves a plain struct to read
+//keys that are missing keep the defaults of the struct, invalid values are logged and keep them too
+template<typename target>
+class config_schema
+{
+public:
+	explicit config_schema(const std::string_view section) : _section(section) {}
+	~config_schema() = default;
+
+	config_schema& field(const std::string_view key, bool target::* member)
+	{
+		return add(key, [member](const config::value_type& values, target& result) {
+			return config::parse(values.front(), result.*member);
+		});
+	}
+
+	config_schema& field(const std::string_view key, std::string target::* member)
+	{
+		return add(key, [member](const config::value_type& values, target& result) {
+			result.*member = values.front();
+			return true;
+		});
+	}
+
+	//integers and floats inside [min, max]
+	template<typename number>
+	config_schema& field(const std::string_view key, number target::* member, const number min, const number max)
+	{
+		return add(key, [member, min, max](const config::value_type& values, target& result) {
+			return parse_number(values.front(), min, max, result.*member);
+		});
+	}
+
+	//enums go through their own from_string
+	template<typename enumeration>
+	config_schema& field(const std::string_view key, enumeration target::* member, enumeration(*from_string)(const std::string&))
+	{
+		return add(key, [member, from_string](const config::value_type& values, target& result) {
+			result.*member = from_string(std::string(values.front()));
+			return true;
+		});
+	}
+
+	//a list is only set when all of its values are given and valid
+	template<typename number, size_t count>
+	config_schema& field(const std::string_view key, std::optional<std::array<number, count>> target::* member, const number min, const number max)
+	{
+		return add(key, [member, min, max](const config::value_type& values, target& result) {
+			std::array<number, count> list = {};
+			if (values.size() < count)
+				return false;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				if (!parse_number(values[i], min, max, list[i]))
+					return false;
+			}
+
+			result.*member = list;
+			return true;
+		});
+	}
+
+	//false when any value was invalid
+	bool apply(const config& ini, target& result) const
+	{
+		bool valid = true;
+		for (const auto& binding : _bindings)
+		{
+			const config::value_type values = ini.value(_section, binding.key);
+			if (values.empty() || binding.read(values, result))
+				continue;
+
+			LOG(WARNING) << "Invalid value for " << binding.key << " in [" << _section << "], the default is kept.\n";
+			valid = false;
+		}
+
+		return valid;
+	}
+
+private:
+	struct binding
+	{
+		std::string key;
+		std::function<bool(const config::value_type&, target&)> read;
+	};
+
+	template<typename number>
+	static bool parse_number(const std::string_view string, const number min, const number max, number& result)
+	{
+		number value = {};
+		if constexpr (std::is_floating_point_v<number>)
+		{
+			double parsed = 0.0;
+			if (!config::parse(string, parsed))
+				return false;
+			value = static_cast<number>(parsed);
+		}
+		else
+		{
+			int parsed = 0;
+			if (!config::parse(string, parsed) || (std::is_unsigned_v<number> && parsed < 0))
+				return false;
+			value = static_cast<number>(parsed);
+		}
+
+		if (value < min || value > max)
+			return false;
+
+		result = value;
+		return true;
+	}
+
+	template<typename reader>
+	config_schema& add(const std::string_view key, reader&& read)
+	{
+		_bindings.push_back({ std::string(key),std::forward<reader>(read) });
+		return *this;
+	}
+
+	std::string _section;
+	std::vector<binding> _bindings;
+};
@@ -4,6 +4,7 @@
 #include "vpl.h"
 #include "normals.h"
 #include "resource.h"
+#include "profiler.h"
 
 #include <d3dcompiler.h>
 #include "backends/imgui_impl_win32.h"
@@ -21,6 +22,7 @@ void d3d12_render_target_set::discard()
 	rtv_table.reset();
 	depth.reset();
 	ds_heap.reset();
+	slices = 1;
 }
 
 bool d3d12_render_target_set::valid() const
@@ -28,16 +30,24 @@ bool d3d12_render_target_set::valid() const
 	return !targets.empty() && rtv_table.get() && depth.get() && ds_heap.get();
 }
 
-bool d3d12_render_target_set::initailize(com_ptr<ID3D12Device> device, const size_t number_of_targets, const DXGI_FORMAT format, const size_t width, const size_t height)
+D3D12_CPU_DESCRIPTOR_HANDLE d3d12_render_target_set::slice_view(const size_t target, const size_t slice) const
 {
-	if (!device || !width || !height || !number_of_targets)
+	//full views first, then one view per slice of every target
+	const size_t rtv_increment = ref_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+	const size_t index = slices > 1 ? targets.size() + target * slices + slice : target;
+	return CD3DX12_CPU_DESCRIPTOR_HANDLE(rtv_table->GetCPUDescriptorHandleForHeapStart(), index, rtv_increment);
+}
+
+bool d3d12_render_target_set::initailize(com_ptr<ID3D12Device> device, const size_t number_of_targets, const DXGI_FORMAT format, const size_t width, const size_t height, const size_t array_size)
+{
+	if (!device || !width || !height || !number_of_targets || !array_size)
 	{
 		return false;
 	}
 
 	com_ptr<ID3D12Resource> target, dep;
-	D3D12_RESOURCE_DESC resource_desc = CD3DX12_RESOURCE_DESC::Tex2D(format, width, height);
-	D3D12_RESOURCE_DESC depth_desc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D24_UNORM_S8_UINT, width, height);
+	D3D12_RESOURCE_DESC resource_desc = CD3DX12_RESOURCE_DESC::Tex2D(format, width, height, array_size, 1);
+	D3D12_RESOURCE_DESC depth_desc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_D24_UNORM_S8_UINT, width, height, array_size, 1);
 	D3D12_HEAP_PROPERTIES pool_props = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
 
 	resource_desc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
@@ -70,7 +80,7 @@ bool d3d12_render_target_set::initailize(com_ptr<ID3D12Device> device, const siz
 		rtv_heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 		rtv_heap_desc.NodeMask = 0;
 		rtv_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-		rtv_heap_desc.NumDescriptors = table_size;
+		rtv_heap_desc.NumDescriptors = array_size > 1 ? table_size * (array_size + 1) : table_size;
 
 		dsv_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
 		dsv_heap_desc.NumDescriptors = 1;
@@ -90,11 +100,26 @@ bool d3d12_render_target_set::initailize(com_ptr<ID3D12Device> device, const siz
 				position.Offset(rtv_increment);
 			}
 
+			for (size_t i = 0; array_size > 1 && i < targets.size(); i++)
+			{
+				for (size_t slice = 0; slice < array_size; slice++)
+				{
+					D3D12_RENDER_TARGET_VIEW_DESC slice_desc = {};
+					slice_desc.Format = format;
+					slice_desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
+					slice_desc.Texture2DArray.FirstArraySlice = slice;
+					slice_desc.Texture2DArray.ArraySize = 1;
+					device->CreateRenderTargetView(targets[i].get(), &slice_desc, position);
+					position.Offset(rtv_increment);
+				}
+			}
+
 			device->CreateDepthStencilView(depth.get(), nullptr, dsv_heap->GetCPUDescriptorHandleForHeapStart());
 
 			ds_heap = dsv_heap;
 			rtv_table = table_heap;
 			ref_device = device;
+			slices = array_size;
 		}
 	}
 
@@ -451,7 +476,7 @@ bool vpl_renderer::initialize(HWND output)
 		!resource_for_calculation.add_empty_resource(device, vpl_data_format, D3D12_RESOURCE_DIMENSION_TEXTURE1D,
 		32 * 256, 1, 1, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST)|| 
 		!resource_for_calculation.add_empty_resource(device, palette_data_format, D3D12_RESOURCE_DIMENSION_TEXTURE1D,
-		3 * 256, 1, 1, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST))
+		palette_texture_width, 1, 1, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST))
 	{
 		return false;
 	}
@@ -552,11 +577,19 @@ void vpl_renderer::clear_renderer()
 	_palette_resource.discard();
 	_pixel_const_buffer.discard();
 	_hva_buffer_storage.clear();
+	_animations.clear();
 	_general_fence.reset_fence();
+	_statistics_queries.reset();
+	_occlusion_queries.reset();
+	_query_readback.reset();
+	_last_stats = {};
+	_batch_stats = {};
 	_resource_descriptor_heaps.reset();
 	_pso.reset();
 	_render_pso.reset();
 	_box_pso.reset();
+	_box_shadow_pso.reset();
+	_shadow_pass_targets.discard();
 	_render_target_views.reset();
 	_depth_stencil_views.reset();
 	_vertex_buffer.discard();
@@ -588,17 +621,26 @@ void vpl_renderer::clear_renderer()
 
 bool vpl_renderer::load_vxl(const vxl& vxl, const hva& hva, const size_t frame, const bool clear)
 {
-	if (!valid() || !vxl.is_loaded() || !hva.is_loaded() || vxl.limb_count() != hva.section_count())
+	PROFILE_SCOPE("vpl_renderer::load_vxl");
+	//sections are matched to limbs by name, the counts may differ
+	if (!valid())
 		return false;
 
 	if(clear)
 		clear_vxl_resources();
 
+	//a missing turret or barrel keeps its place without sections, reload_hva skips it
+	hva_animation animation;
+	if (!vxl.is_loaded() || !hva.is_loaded() || !animation.build(vxl, hva))
+	{
+		_animations.emplace_back();
+		return false;
+	}
+
 	const size_t limbs = vxl.limb_count();
 	for (size_t i = 0; i < limbs; i++)
 	{
 		const vxl_limb_tailer* tailer = vxl.limb_tailer(i);
-		const vxlmatrix matrix = *hva.matrix(frame % hva.frame_count(), i);
 		//const size_t maximum_vxl_buffer_size = sizeof vxl_buffer_decl * tailer->xsize * tailer->ysize * tailer->zsize;
 		com_ptr<ID3D12Resource> temp_resources;
 
@@ -659,23 +701,7 @@ bool vpl_renderer::load_vxl(const vxl& vxl, const hva& hva, const size_t frame,
 			tempdata.vxl_maxbound.vector4_f32[3] = 0.0f;
 
 			tempdata.light_direction = _states.light_direction;
-
-			tempdata.vxl_transformation.m[0][0] = matrix._data[0][0];
-			tempdata.vxl_transformation.m[0][1] = matrix._data[1][0];
-			tempdata.vxl_transformation.m[0][2] = matrix._data[2][0];
-			tempdata.vxl_transformation.m[0][3] = 0.0f;
-			tempdata.vxl_transformation.m[1][0] = matrix._data[0][1];
-			tempdata.vxl_transformation.m[1][1] = matrix._data[1][1];
-			tempdata.vxl_transformation.m[1][2] = matrix._data[2][1];
-			tempdata.vxl_transformation.m[1][3] = 0.0f;
-			tempdata.vxl_transformation.m[2][0] = matrix._data[0][2];
-			tempdata.vxl_transformation.m[2][1] = matrix._data[1][2];
-			tempdata.vxl_transformation.m[2][2] = matrix._data[2][2];
-			tempdata.vxl_transformation.m[2][3] = 0.0f;
-			tempdata.vxl_transformation.m[3][0] = matrix._data[0][3];
-			tempdata.vxl_transformation.m[3][1] = matrix._data[1][3];
-			tempdata.vxl_transformation.m[3][2] = matrix._data[2][3];
-			tempdata.vxl_transformation.m[3][3] = 1.0f;
+			tempdata.vxl_transformation = animation.model(frame, i);
 
 			tempdata.section_buffer_size = buffer_size;
 			_hva_buffer_storage.push_back(tempdata);
@@ -713,6 +739,7 @@ bool vpl_renderer::load_vxl(const vxl& vxl, const hva& hva, const size_t frame,
 		return false;
 	}
 
+	_animations.push_back(std::move(animation));
 	return _renderer_resource_dirty = true;
 }
 
@@ -741,34 +768,151 @@ bool vpl_renderer::load_vpl(const vpl& vpl)
 	return false;
 }
 
+bool vpl_renderer::update_vpl(const vpl& vpl)
+{
+	if (!valid() || !vpl.is_loaded())
+		return false;
+
+	if (_vpl_resource.resources.empty() || !_vpl_resource.valid())
+		return load_vpl(vpl);
+
+	if (!vpl.is_dirty())
+		return true;
+
+	//texel spans of the 1d table, every span is placed at its own aligned offset in the upload buffer
+	struct span
+	{
+		uint32_t offset, length;
+	};
+
+	std::vector<span> spans;
+	const auto& ranges = vpl.dirty_ranges();
+	for (size_t section = 0; section < std::min(ranges.size(), (size_t)32u); section++)
+	{
+		if (!ranges[section].empty())
+			spans.push_back({ static_cast<uint32_t>(section * 256u + ranges[section].begin),ranges[section].end - ranges[section].begin });
+	}
+
+	if (spans.empty())
+		return true;
+
+	const com_ptr<ID3D12Resource>& destination = _vpl_resource.resources[0];
+	const com_ptr<ID3D12Resource>& upload = _upload_buffers.resources[vpl_upload_buffer_idx];
+	const size_t upload_size = upload->GetDesc().Width;
+	auto placed_offset = [](const size_t idx) {
+		return idx * D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT;
+	};
+
+	//too many spans to place, one span over all of them still fits
+	if (placed_offset(spans.size() - 1u) + resource_pitch(spans.back().length) > upload_size)
+	{
+		const uint32_t first = spans.front().offset;
+		spans = { { first,spans.back().offset + spans.back().length - first } };
+	}
+
+	byte* upload_data = nullptr;
+	if (FAILED(upload->Map(0, nullptr, reinterpret_cast<void**>(&upload_data))))
+	{
+		LOG(ERROR) << "Failed to map vpl upload buffer.\n";
+		return false;
+	}
+
+	const byte* table = reinterpret_cast<const byte*>(vpl.data());
+	for (size_t i = 0; i < spans.size(); i++)
+		memcpy(upload_data + placed_offset(i), table + spans[i].offset, spans[i].length);
+	upload->Unmap(0, nullptr);
+
+	if (!begin_command())
+		return false;
+
+	for (size_t i = 0; i < spans.size(); i++)
+	{
+		D3D12_TEXTURE_COPY_LOCATION dst_location = {}, src_location = {};
+		dst_location.pResource = destination.get();
+		dst_location.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+		dst_location.SubresourceIndex = 0;
+
+		src_location.pResource = upload.get();
+		src_location.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+		src_location.PlacedFootprint.Offset = placed_offset(i);
+		src_location.PlacedFootprint.Footprint.Format = vpl_data_format;
+		src_location.PlacedFootprint.Footprint.Width = spans[i].length;
+		src_location.PlacedFootprint.Footprint.Height = 1;
+		src_location.PlacedFootprint.Footprint.Depth = 1;
+		src_location.PlacedFootprint.Footprint.RowPitch = resource_pitch(spans[i].length);
+
+		_resource_commands.commands->CopyTextureRegion(&dst_location, spans[i].offset, 0, 0, &src_location, nullptr);
+	}
+
+	execute_commands();
+	return wait_for_completion();
+}
+
 bool vpl_renderer::load_pal(const palette& palette)
 {
 	if (!valid() || !palette.is_loaded())
 		return false;
 
 	_palette_resource.discard();
-	if (_palette_resource.add_empty_resource(_device, vpl_data_format, D3D12_RESOURCE_DIMENSION_TEXTURE1D, 3 * 256, 1, 1,
+	if (_palette_resource.add_empty_resource(_device, vpl_data_format, D3D12_RESOURCE_DIMENSION_TEXTURE1D, palette_texture_width, 1, 1,
 		D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COPY_DEST))
 	{
-		const com_ptr<ID3D12Resource>& destination = _palette_resource.resources[0];
-		const com_ptr<ID3D12Resource>& upload = _upload_buffers.resources[palette_upload_buffer_idx];
-		if (begin_command())
-		{
-			D3D12_SUBRESOURCE_DATA subres = {};
-			subres.pData = palette.entry();
-			subres.RowPitch = subres.SlicePitch = 3 * 256;
-			UpdateSubresources(_resource_commands.commands.get(), destination.get(), upload.get(), 0, 0, 1, &subres);
-			execute_commands();
-			return _renderer_resource_dirty = wait_for_completion();
-		}
+		_palette = palette;
+		return _renderer_resource_dirty = upload_palette();
 	}
 
 	return false;
 }
 
+bool vpl_renderer::upload_palette()
+{
+	if (_palette_resource.resources.empty() || !_palette_resource.valid())
+		return false;
+
+	const color remap = current_remap();
+	const float extra_light = get_extra_light();
+	//the compute path only brightens the ramp, the box path every entry
+	const std::array<color_table, 2> entries = { *_palette.remapped(remap, extra_light),*_palette.lit(remap, extra_light) };
+
+	const com_ptr<ID3D12Resource>& destination = _palette_resource.resources[0];
+	const com_ptr<ID3D12Resource>& upload = _upload_buffers.resources[palette_upload_buffer_idx];
+	if (!begin_command())
+		return false;
+
+	D3D12_SUBRESOURCE_DATA subres = {};
+	subres.pData = entries.data();
+	subres.RowPitch = subres.SlicePitch = sizeof entries;
+	UpdateSubresources(_resource_commands.commands.get(), destination.get(), upload.get(), 0, 0, 1, &subres);
+	execute_commands();
+	if (!wait_for_completion())
+		return false;
+
+	_uploaded_remap = remap;
+	_uploaded_extra_light = extra_light;
+	return true;
+}
+
+void vpl_renderer::refresh_palette()
+{
+	const color remap = current_remap();
+	if (_palette_resource.resources.empty() || (remap.r == _uploaded_remap.r && remap.g == _uploaded_remap.g && remap.b == _uploaded_remap.b &&
+		get_extra_light() == _uploaded_extra_light))
+		return;
+
+	if (!upload_palette())
+		LOG(ERROR) << "Failed to upload the remapped palette.\n";
+}
+
+color vpl_renderer::current_remap() const
+{
+	return { static_cast<byte>(_states.remap_color.vector4_f32[0]),static_cast<byte>(_states.remap_color.vector4_f32[1]),
+		static_cast<byte>(_states.remap_color.vector4_f32[2]) };
+}
+
 bool vpl_renderer::reload_hva(const hva* hvas[], const size_t frames[], const float prerotation[], const float offsets[], const size_t numhvas)
 {
-	if (!valid() || !numhvas)
+	PROFILE_SCOPE("vpl_renderer::reload_hva");
+	if (!valid() || !numhvas || numhvas > _animations.size())
 		return false;
 
 	//pre check
@@ -779,7 +923,7 @@ bool vpl_renderer::reload_hva(const hva* hvas[], const size_t frames[], const fl
 		if (!pv)
 			return false;
 		else
-			total_data_set += pv->section_count();
+			total_data_set += _animations[i].section_count();
 	}
 
 	if (total_data_set != _hva_buffer_storage.size())
@@ -791,13 +935,13 @@ bool vpl_renderer::reload_hva(const hva* hvas[], const size_t frames[], const fl
 	{
 		const hva& hva = *hvas[i];
 		const size_t real_frame = hva.frame_count() ? (frames[i] % hva.frame_count()) : 0;/* ? 0 : frames[i];*/
-		DirectX::XMMATRIX prerot = DirectX::XMMatrixIdentity();
+		float prerot = 0.0f;
 
 		if (prerotation)
 		{
 			__try
 			{
-				prerot = DirectX::XMMatrixRotationZ(prerotation[i]);
+				prerot = prerotation[i];
 			}
 			__except (1)
 			{
@@ -805,28 +949,23 @@ bool vpl_renderer::reload_hva(const hva* hvas[], const size_t frames[], const fl
 			}
 		}
 
-		for (size_t s = 0; s < hva.section_count(); s++)
+		//the transforms of every frame are composed once per hva
+		hva_animation& animation = _animations[i];
+		if (!animation.section_count())
+			continue;
+
+		if (!animation.built_for(hva) && !animation.rebuild(hva))
+			return false;
+
+		for (size_t s = 0; s < animation.section_count(); s++)
 		{
 			vxl_cbuffer_data& tempdata = _hva_buffer_storage[loading_section++];
-			const vxlmatrix& matrix = *hva.matrix(real_frame, s);
 			tempdata.light_direction = _states.light_direction;
-			tempdata.vxl_transformation.m[0][0] = matrix._data[0][0];
-			tempdata.vxl_transformation.m[0][1] = matrix._data[1][0];
-			tempdata.vxl_transformation.m[0][2] = matrix._data[2][0];
-			tempdata.vxl_transformation.m[1][0] = matrix._data[0][1];
-			tempdata.vxl_transformation.m[1][1] = matrix._data[1][1];
-			tempdata.vxl_transformation.m[1][2] = matrix._data[2][1];
-			tempdata.vxl_transformation.m[2][0] = matrix._data[0][2];
-			tempdata.vxl_transformation.m[2][1] = matrix._data[1][2];
-			tempdata.vxl_transformation.m[2][2] = matrix._data[2][2];
-			tempdata.vxl_transformation.m[3][0] = matrix._data[0][3];
-			tempdata.vxl_transformation.m[3][1] = matrix._data[1][3];
-			tempdata.vxl_transformation.m[3][2] = matrix._data[2][3];
 
 			if(offsets)
 				tempdata.vxl_maxbound.vector4_f32[3] = offsets[i];
 
-			tempdata.vxl_transformation *= prerot;
+			tempdata.vxl_transformation = animation.model(real_frame, s, prerot, tempdata.vxl_maxbound.vector4_f32[3]);
 		}
 	}
 
@@ -1029,6 +1168,7 @@ void vpl_renderer::clear_vxl_resources()
 		_hva_buffer_storage.clear();
 		_hva_resource.resources.erase(_hva_resource.resources.begin() + 1, _hva_resource.resources.end());
 		_hva_buffer_storage.clear();
+		_animations.clear();
 	}
 }
 
@@ -1121,7 +1261,7 @@ bool vpl_renderer::init_pipeline_state()
 			shader_code = LockResource(res_heap);
 	}
 
-	com_ptr<ID3DBlob> compute_shader, pixel_shader, vertex_shader, box_vshader, box_pshader;
+	com_ptr<ID3DBlob> compute_shader, pixel_shader, vertex_shader, box_vshader, box_pshader, box_shadow_vshader, box_gshader;
 #ifdef _DEBUG
 	UINT compile_flag = D3DCOMPILE_DEBUG;
 #else
@@ -1156,6 +1296,18 @@ bool vpl_renderer::init_pipeline_state()
 		LOG(ERROR) << "Compiling shaders.\n" << (LPSTR)error->GetBufferPointer() << ".\n";
 		return false;
 	}
+	error.reset();
+	if (FAILED(D3DCompile(shader_code, res_size, nullptr, nullptr, nullptr, "box_shadow_vmain", "vs_5_1", compile_flag, 0, &box_shadow_vshader, &error)))
+	{
+		LOG(ERROR) << "Compiling shaders.\n" << (LPSTR)error->GetBufferPointer() << ".\n";
+		return false;
+	}
+	error.reset();
+	if (FAILED(D3DCompile(shader_code, res_size, nullptr, nullptr, nullptr, "box_gmain", "gs_5_1", compile_flag, 0, &box_gshader, &error)))
+	{
+		LOG(ERROR) << "Compiling shaders.\n" << (LPSTR)error->GetBufferPointer() << ".\n";
+		return false;
+	}
 
 	D3D12_COMPUTE_PIPELINE_STATE_DESC compute_pipeline = {};
 	compute_pipeline.CS = CD3DX12_SHADER_BYTECODE(compute_shader.get());
@@ -1213,7 +1365,12 @@ bool vpl_renderer::init_pipeline_state()
 	boxpipe.DepthStencilState.StencilEnable = FALSE;
 	boxpipe.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
-	com_ptr<ID3D12PipelineState> pipeline_state, graphic_pipeline, box_pipeline;
+	//same states, the geometry shader sends every box to the color slice and the shadow slice
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC box_shadow_pipe = boxpipe;
+	box_shadow_pipe.VS = CD3DX12_SHADER_BYTECODE(box_shadow_vshader.get());
+	box_shadow_pipe.GS = CD3DX12_SHADER_BYTECODE(box_gshader.get());
+
+	com_ptr<ID3D12PipelineState> pipeline_state, graphic_pipeline, box_pipeline, box_shadow_pipeline;
 	if (FAILED(_device->CreateComputePipelineState(&compute_pipeline, IID_PPV_ARGS(&pipeline_state)))) 
 	{
 		LOG(ERROR) << "PSO creation failed.\n";
@@ -1231,6 +1388,12 @@ bool vpl_renderer::init_pipeline_state()
 		return false;
 	}
 
+	if (FAILED(_device->CreateGraphicsPipelineState(&box_shadow_pipe, IID_PPV_ARGS(&box_shadow_pipeline))))
+	{
+		LOG(ERROR) << "PSO creation failed (BOX SHADOW).\n";
+		return false;
+	}
+
 	const com_ptr<ID3D12GraphicsCommandList>& commands = _resource_commands.commands;
 	const com_ptr<ID3D12Resource>& normal_table = _hva_resource.resources[0].get();
 	const com_ptr<ID3D12Resource>& vert_buffer = _vertex_buffer.resources[0].get();
@@ -1273,6 +1436,11 @@ bool vpl_renderer::init_pipeline_state()
 	_pso = pipeline_state;
 	_render_pso = graphic_pipeline;
 	_box_pso = box_pipeline;
+	_box_shadow_pso = box_shadow_pipeline;
+
+	//renders still work without counters
+	if (!create_statistics_queries())
+		LOG(WARNING) << "Render statistics are not available.\n";
 	return valid();
 }
 
@@ -1321,6 +1489,7 @@ bool vpl_renderer::transition_state(ID3D12Resource* resource, const D3D12_RESOUR
 
 bool vpl_renderer::render_loaded_vxl()
 {
+	PROFILE_SCOPE("vpl_renderer::render_loaded_vxl");
 	if (!valid() || !vxl_resource_initiated())
 		return false;
 
@@ -1362,20 +1531,14 @@ bool vpl_renderer::render_loaded_vxl()
 		wait_for_completion();
 	}
 
+	render_stats stats;
+	stats.renders = 1;
 	for (size_t i = 0; i < final_data.size(); i++)
 	{
 		//preparing hva data
 		vxl_cbuffer_data& data = final_data[i];
-		//scale & rotation & translation
-		DirectX::XMMATRIX translation_to_center = {}, scale = {}, offset = {}, base = data.vxl_transformation;
-		DirectX::XMVECTOR scale_vec = (data.vxl_maxbound - data.vxl_minbound) / data.vxl_dimension;
-		translation_to_center = DirectX::XMMatrixTranslationFromVector(data.vxl_minbound);
-		scale = DirectX::XMMatrixScalingFromVector(scale_vec);
-		offset = DirectX::XMMatrixTranslation(data.vxl_maxbound.vector4_f32[3], 0.0f, 0.0f);
-		base.m[3][0] *= scale_vec.vector4_f32[0] * data.vxl_dimension.vector4_f32[3];
-		base.m[3][1] *= scale_vec.vector4_f32[1] * data.vxl_dimension.vector4_f32[3];
-		base.m[3][2] *= scale_vec.vector4_f32[2] * data.vxl_dimension.vector4_f32[3];
-		data.vxl_transformation = translation_to_center * scale * base * offset * _states.world;
+		//the model transform was composed when the pose was loaded
+		data.vxl_transformation = data.vxl_transformation * _states.world;
 		data.remap_color = _states.remap_color;
 		data.light_direction = _states.light_direction;
 		
@@ -1403,9 +1566,13 @@ bool vpl_renderer::render_loaded_vxl()
 		transition_state(vxl_resource.get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 		transition_state(vpl_resource.get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 		uint32_t buffer_size = static_cast<uint32_t>(data.vxl_minbound.vector4_f32[3]);
+		stats.voxels_submitted += buffer_size;
 
 		if (!_hardware_processing)
 		{
+			//the compute pass tests depth in the shader, only the submitted splats are known here
+			stats.primitives_submitted += buffer_size;
+
 			commands->SetComputeRootSignature(_root_signature.get());
 			commands->SetComputeRootDescriptorTable(0, _resource_descriptor_heaps->GetGPUDescriptorHandleForHeapStart());
 			commands->SetComputeRootDescriptorTable(1, _resource_descriptor_heaps->GetGPUDescriptorHandleForHeapStart());
@@ -1452,7 +1619,9 @@ bool vpl_renderer::render_loaded_vxl()
 			//prepare input assembly
 			commands->IASetVertexBuffers(0, 1, &box_vert_view);
 			commands->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			begin_statistics();
 			commands->DrawInstanced(box_vert_view.SizeInBytes / box_vert_view.StrideInBytes, buffer_size, 0, 0);
+			end_statistics();
 
 			transition_state(_swapchain.targets[buffer_idx].get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
 			_box_rendered = true;
@@ -1462,9 +1631,11 @@ bool vpl_renderer::render_loaded_vxl()
 		transition_state(vpl_resource.get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
 		//execute commands & wait for completion
 		execute_commands();
-		wait_for_completion();
+		if (wait_for_completion() && _hardware_processing)
+			read_statistics(stats);
 	}
 
+	record_stats(stats);
 	return true;
 }
 
@@ -1513,16 +1684,8 @@ bool vpl_renderer::render_temp_screenshot(const size_t w, const size_t h, std::v
 	{
 		//preparing hva data
 		vxl_cbuffer_data& data = final_data[i];
-		//scale & rotation & translation
-		DirectX::XMMATRIX translation_to_center = {}, scale = {}, offset = {}, base = data.vxl_transformation;
-		DirectX::XMVECTOR scale_vec = (data.vxl_maxbound - data.vxl_minbound) / data.vxl_dimension;
-		translation_to_center = DirectX::XMMatrixTranslationFromVector(data.vxl_minbound);
-		scale = DirectX::XMMatrixScalingFromVector(scale_vec);
-		offset = DirectX::XMMatrixTranslation(data.vxl_maxbound.vector4_f32[3], 0.0f, 0.0f);
-		base.m[3][0] *= scale_vec.vector4_f32[0] * data.vxl_dimension.vector4_f32[3];
-		base.m[3][1] *= scale_vec.vector4_f32[1] * data.vxl_dimension.vector4_f32[3];
-		base.m[3][2] *= scale_vec.vector4_f32[2] * data.vxl_dimension.vector4_f32[3];
-		data.vxl_transformation = translation_to_center * scale * base * offset * _states.world;
+		//the model transform was composed when the pose was loaded
+		data.vxl_transformation = data.vxl_transformation * _states.world;
 		data.remap_color = _states.remap_color;
 		data.light_direction = _states.light_direction;
 
@@ -1609,6 +1772,154 @@ bool vpl_renderer::render_temp_screenshot(const size_t w, const size_t h, std::v
 }
 
 
+bool vpl_renderer::render_loaded_vxl_with_shadow(const DirectX::XMMATRIX& shadow_world, cropped_frame& color, cropped_frame& shadow)
+{
+	PROFILE_SCOPE("vpl_renderer::render_loaded_vxl_with_shadow");
+	if (!valid() || !vxl_resource_initiated() || !_hardware_processing || !_box_shadow_pso)
+		return false;
+
+	const com_ptr<ID3D12GraphicsCommandList>& commands = _resource_commands.commands;
+	const com_ptr<ID3D12Resource>& vpl_resource = _vpl_resource.resources[0];
+
+	com_ptr<ID3D12Resource> temp_resource = _upload_buffers.resources[hva_constants_upload_buffer_idx];
+	std::vector<vxl_cbuffer_data> final_data = _hva_buffer_storage;
+
+	//slice 0 takes the color, slice 1 the shadow coverage
+	if (_shadow_pass_targets.valid())
+	{
+		const auto desc = _shadow_pass_targets.targets[0]->GetDesc();
+		if (desc.Width != width() || desc.Height != height())
+			_shadow_pass_targets.discard();
+	}
+
+	if (!_shadow_pass_targets.valid() &&
+		!_shadow_pass_targets.initailize(_device, 1u, DXGI_FORMAT_R8G8B8A8_UNORM, width(), height(), 2u))
+	{
+		LOG(ERROR) << "Failed to create shadow pass targets.\n";
+		return false;
+	}
+
+	if (_renderer_resource_dirty)
+	{
+		bind_resource_table(-1);
+		_renderer_resource_dirty = false;
+	}
+
+	const com_ptr<ID3D12Resource>& target_array = _shadow_pass_targets.targets[0];
+	D3D12_CPU_DESCRIPTOR_HANDLE target = _shadow_pass_targets.rtv_table->GetCPUDescriptorHandleForHeapStart();
+	D3D12_CPU_DESCRIPTOR_HANDLE depth = _shadow_pass_targets.ds_heap->GetCPUDescriptorHandleForHeapStart();
+
+	if (begin_command())
+	{
+		const float shadow_clear[] = { 0.0f,0.0f,1.0f,0.0f };
+		commands->ClearRenderTargetView(_shadow_pass_targets.slice_view(0, 0), _states.bgcolor.vector4_f32, 0, nullptr);
+		commands->ClearRenderTargetView(_shadow_pass_targets.slice_view(0, 1), shadow_clear, 0, nullptr);
+		commands->ClearDepthStencilView(depth, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+		execute_commands();
+		wait_for_completion();
+	}
+
+	render_stats stats;
+	stats.renders = 1;
+	for (size_t i = 0; i < final_data.size(); i++)
+	{
+		//preparing hva data
+		vxl_cbuffer_data& data = final_data[i];
+		//the model transform was composed when the pose was loaded
+		const DirectX::XMMATRIX model = data.vxl_transformation;
+		data.vxl_transformation = model * _states.world;
+		data.shadow_transformation = model * shadow_world;
+		data.remap_color = _states.remap_color;
+		data.light_direction = _states.light_direction;
+
+		//bind resources
+		bind_resource_table(i);
+		//start recording commands
+		if (!begin_command())
+			continue;
+
+		const com_ptr<ID3D12Resource>& vxl_resource = _vxl_resource.resources[i + 1];
+		const com_ptr<ID3D12Resource>& hva_resource = _hva_resource.resources[i + 1];
+
+		//upload hva and light data
+		D3D12_SUBRESOURCE_DATA subres = {};
+		subres.pData = &data;
+		subres.RowPitch = sizeof data;
+		subres.SlicePitch = sizeof data;
+
+		transition_state(hva_resource.get(), D3D12_RESOURCE_STATE_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+		UpdateSubresources(commands.get(), hva_resource.get(), temp_resource.get(), 0, 0, 1, &subres);
+		transition_state(hva_resource.get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_SHADER_RESOURCE);
+
+		ID3D12DescriptorHeap* heaps[] = { _resource_descriptor_heaps.get() };
+		commands->SetDescriptorHeaps(_countof(heaps), heaps);
+		transition_state(vxl_resource.get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		transition_state(vpl_resource.get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		uint32_t buffer_size = static_cast<uint32_t>(data.vxl_minbound.vector4_f32[3]);
+		stats.voxels_submitted += buffer_size;
+
+		{
+			upload_scene_states state_constants = {};
+			state_constants.data = _states;
+			D3D12_SUBRESOURCE_DATA subres = {};
+			subres.pData = &state_constants;
+			subres.RowPitch = subres.SlicePitch = sizeof state_constants;
+			transition_state(_pixel_const_buffer.resources[0].get(), D3D12_RESOURCE_STATE_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
+			UpdateSubresources(commands.get(), _pixel_const_buffer.resources[0].get(), _upload_buffers.resources[pixel_upload_buffer_idx].get(), 0, 0, 1, &subres);
+			transition_state(_pixel_const_buffer.resources[0].get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_SHADER_RESOURCE);
+
+			commands->OMSetRenderTargets(1, &target, false, &depth);
+
+			commands->SetGraphicsRootSignature(_root_signature.get());
+			commands->SetGraphicsRootDescriptorTable(0, _resource_descriptor_heaps->GetGPUDescriptorHandleForHeapStart());
+			commands->SetGraphicsRootDescriptorTable(1, _resource_descriptor_heaps->GetGPUDescriptorHandleForHeapStart());
+			commands->SetGraphicsRootDescriptorTable(2, _resource_descriptor_heaps->GetGPUDescriptorHandleForHeapStart());
+
+			commands->SetPipelineState(_box_shadow_pso.get());
+
+			D3D12_VIEWPORT viewport = { 0,0,width(),height(),0.0f,1.0f };
+			D3D12_RECT scissor_rect = { 0,0,width(),height() };
+			commands->RSSetViewports(1, &viewport);
+			commands->RSSetScissorRects(1, &scissor_rect);
+
+			D3D12_VERTEX_BUFFER_VIEW box_vert_view = {};
+			box_vert_view.BufferLocation = _vertex_buffer.resources[box_vert_buffer_idx]->GetGPUVirtualAddress();
+			box_vert_view.SizeInBytes = sizeof box_vertex_data;
+			box_vert_view.StrideInBytes = sizeof box_vertex_data::face_vertex_data::_ld;
+
+			//prepare input assembly
+			commands->IASetVertexBuffers(0, 1, &box_vert_view);
+			commands->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			begin_statistics();
+			commands->DrawInstanced(box_vert_view.SizeInBytes / box_vert_view.StrideInBytes, buffer_size, 0, 0);
+			end_statistics();
+		}
+
+		transition_state(vxl_resource.get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+		transition_state(vpl_resource.get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+		//execute commands & wait for completion
+		execute_commands();
+		if (wait_for_completion())
+			read_statistics(stats);
+	}
+
+	//the geometry shader emits every triangle to both slices, the counters include both
+	record_stats(stats);
+
+	const auto read_slice = [this, &target_array](const size_t slice, cropped_frame& frame) {
+		return read_back(D3D12_RESOURCE_STATE_RENDER_TARGET, target_array, DXGI_FORMAT_R8G8B8A8_UNORM, 4u,
+			[&frame](const byte* mapped_data, const size_t download_pitch, const size_t width, const size_t height) {
+				frame = cropped_frame::from_rows(mapped_data, download_pitch, width, height);
+			}, slice);
+	};
+
+	if (!read_slice(0, color) || !read_slice(1, shadow))
+		return false;
+
+	record_coverage(color.visible_pixels() + shadow.visible_pixels());
+	return true;
+}
+
 bool vpl_renderer::render_gui(const bool clear_target)
 {
 	if (!valid())
@@ -1808,15 +2119,152 @@ std::vector<byte> vpl_renderer::render_target_data()
 std::vector<byte> vpl_renderer::download_buffer(const D3D12_RESOURCE_STATES prev_state, com_ptr<ID3D12Resource> target, const DXGI_FORMAT download_fmt, const size_t ele_size)
 {
 	std::vector<byte> buffer;
+
+	read_back(prev_state, target, download_fmt, ele_size,
+		[&buffer, ele_size](const byte* mapped_data, const size_t download_pitch, const size_t width, const size_t height) {
+			const size_t data_pitch = width * ele_size;
+			buffer.resize(data_pitch * height);
+			for (size_t i = 0; i < height; i++)
+				memcpy_s(&buffer[i * data_pitch], data_pitch, &mapped_data[i * download_pitch], data_pitch);
+		});
+
+	return buffer;
+}
+
+cropped_frame vpl_renderer::render_target_frame()
+{
+	cropped_frame frame;
+
+	read_back(D3D12_RESOURCE_STATE_PRESENT, _swapchain.targets[_swapchain.current_idx], DXGI_FORMAT_R8G8B8A8_UINT, 4u,
+		[&frame](const byte* mapped_data, const size_t download_pitch, const size_t width, const size_t height) {
+			frame = cropped_frame::from_rows(mapped_data, download_pitch, width, height);
+		});
+
+	record_coverage(frame.visible_pixels());
+	return frame;
+}
+
+const render_stats& vpl_renderer::last_render_stats() const
+{
+	return _last_stats;
+}
+
+const render_stats& vpl_renderer::batch_stats() const
+{
+	return _batch_stats;
+}
+
+void vpl_renderer::reset_batch_stats()
+{
+	_batch_stats = {};
+}
+
+bool vpl_renderer::create_statistics_queries()
+{
+	if (_statistics_queries && _occlusion_queries && _query_readback)
+		return true;
+
+	com_ptr<ID3D12QueryHeap> statistics_queries, occlusion_queries;
+	com_ptr<ID3D12Resource> query_readback;
+
+	D3D12_QUERY_HEAP_DESC statistics_desc = {};
+	statistics_desc.Type = D3D12_QUERY_HEAP_TYPE_PIPELINE_STATISTICS;
+	statistics_desc.Count = 1;
+
+	D3D12_QUERY_HEAP_DESC occlusion_desc = {};
+	occlusion_desc.Type = D3D12_QUERY_HEAP_TYPE_OCCLUSION;
+	occlusion_desc.Count = 1;
+
+	//the statistics come first, the passed samples right after them
+	D3D12_HEAP_PROPERTIES read_heap = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+	D3D12_RESOURCE_DESC read_desc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS) + sizeof(uint64_t));
+
+	if (FAILED(_device->CreateQueryHeap(&statistics_desc, IID_PPV_ARGS(&statistics_queries))) ||
+		FAILED(_device->CreateQueryHeap(&occlusion_desc, IID_PPV_ARGS(&occlusion_queries))) ||
+		FAILED(_device->CreateCommittedResource(&read_heap, D3D12_HEAP_FLAG_NONE, &read_desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&query_readback))))
+	{
+		LOG(ERROR) << "Failed to create render statistics queries.\n";
+		return false;
+	}
+
+	_statistics_queries = statistics_queries;
+	_occlusion_queries = occlusion_queries;
+	_query_readback = query_readback;
+	return true;
+}
+
+void vpl_renderer::begin_statistics()
+{
+	if (!_query_readback)
+		return;
+
+	_resource_commands.commands->BeginQuery(_statistics_queries.get(), D3D12_QUERY_TYPE_PIPELINE_STATISTICS, 0);
+	_resource_commands.commands->BeginQuery(_occlusion_queries.get(), D3D12_QUERY_TYPE_OCCLUSION, 0);
+}
+
+void vpl_renderer::end_statistics()
+{
+	if (!_query_readback)
+		return;
+
+	const com_ptr<ID3D12GraphicsCommandList>& commands = _resource_commands.commands;
+	commands->EndQuery(_statistics_queries.get(), D3D12_QUERY_TYPE_PIPELINE_STATISTICS, 0);
+	commands->EndQuery(_occlusion_queries.get(), D3D12_QUERY_TYPE_OCCLUSION, 0);
+	commands->ResolveQueryData(_statistics_queries.get(), D3D12_QUERY_TYPE_PIPELINE_STATISTICS, 0, 1, _query_readback.get(), 0);
+	commands->ResolveQueryData(_occlusion_queries.get(), D3D12_QUERY_TYPE_OCCLUSION, 0, 1, _query_readback.get(), sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS));
+}
+
+void vpl_renderer::read_statistics(render_stats& stats)
+{
+	if (!_query_readback)
+		return;
+
+	D3D12_QUERY_DATA_PIPELINE_STATISTICS pipeline = {};
+	uint64_t samples = 0;
+	byte* mapped_data = nullptr;
+	const D3D12_RANGE read_range = { 0,sizeof pipeline + sizeof samples };
+	if (FAILED(_query_readback->Map(0, &read_range, reinterpret_cast<void**>(&mapped_data))))
+		return;
+
+	memcpy(&pipeline, mapped_data, sizeof pipeline);
+	memcpy(&samples, mapped_data + sizeof pipeline, sizeof samples);
+	const D3D12_RANGE written_range = { 0,0 };
+	_query_readback->Unmap(0, &written_range);
+
+	//the box pipelines do not cull faces, back faces are drawn and lose the depth test instead
+	//triangles outside the viewport are dropped by the clipper, the ones it splits can hide a few of them
+	//with early depth testing a rejected fragment never reaches the pixel shader and is not counted
+	stats.primitives_submitted += pipeline.CInvocations;
+	stats.off_canvas += pipeline.CInvocations - std::min(pipeline.CPrimitives, pipeline.CInvocations);
+	stats.depth_rejected += pipeline.PSInvocations - std::min(samples, pipeline.PSInvocations);
+	stats.pixels_written += samples;
+}
+
+void vpl_renderer::record_stats(const render_stats& stats)
+{
+	_last_stats = stats;
+	_batch_stats += stats;
+}
+
+void vpl_renderer::record_coverage(const uint64_t pixels)
+{
+	//reading the same frame again replaces its coverage
+	_batch_stats.pixels_covered += pixels - _last_stats.pixels_covered;
+	_last_stats.pixels_covered = pixels;
+}
+
+bool vpl_renderer::read_back(const D3D12_RESOURCE_STATES prev_state, com_ptr<ID3D12Resource> target, const DXGI_FORMAT download_fmt, const size_t ele_size, const readback_handler& handler, const size_t subresource)
+{
+	PROFILE_SCOPE("vpl_renderer::read_back");
 	com_ptr<ID3D12Resource> result;
 
-	const auto desc = target->GetDesc();
-	if (!valid())
-		return buffer;
+	if (!valid() || !target)
+		return false;
 
 	//const com_ptr<ID3D12Resource> target = _swapchain.targets[_swapchain.current_idx];
+	const auto desc = target->GetDesc();
 	const com_ptr<ID3D12GraphicsCommandList>& commands = _resource_commands.commands;
-	const size_t imm_size = GetRequiredIntermediateSize(target.get(), 0, 1);
+	const size_t imm_size = GetRequiredIntermediateSize(target.get(), subresource, 1);
 	const size_t data_pitch = desc.Width * ele_size;
 	const size_t download_pitch = resource_pitch(data_pitch);
 
@@ -1827,7 +2275,7 @@ std::vector<byte> vpl_renderer::download_buffer(const D3D12_RESOURCE_STATES prev
 		&read_desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&result))))
 	{
 		LOG(ERROR) << "Failed to create read back resource - download target gen.\n";
-		return buffer;
+		return false;
 	}
 
 	if (begin_command())
@@ -1836,7 +2284,7 @@ std::vector<byte> vpl_renderer::download_buffer(const D3D12_RESOURCE_STATES prev
 
 		D3D12_TEXTURE_COPY_LOCATION src_location = { target.get() };
 		src_location.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-		src_location.SubresourceIndex = 0;
+		src_location.SubresourceIndex = subresource;
 
 		D3D12_TEXTURE_COPY_LOCATION dst_location = { result.get() };
 		dst_location.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
@@ -1855,16 +2303,14 @@ std::vector<byte> vpl_renderer::download_buffer(const D3D12_RESOURCE_STATES prev
 			byte* mapped_data = nullptr;
 			if (SUCCEEDED(result->Map(0, nullptr, reinterpret_cast<void**>(&mapped_data))))
 			{
-				buffer.resize(data_pitch * desc.Height);
-				for (size_t i = 0; i < desc.Height; i++)
-					memcpy_s(&buffer[i * data_pitch], data_pitch, &mapped_data[i * download_pitch], data_pitch);
+				handler(mapped_data, download_pitch, desc.Width, desc.Height);
 				result->Unmap(0, nullptr);
-				return buffer;
+				return true;
 			}
 		}
 	}
 
-	return buffer;
+	return false;
 }
 
 void vpl_renderer::set_light_dir(const DirectX::XMVECTOR& dir)
@@ -1890,11 +2336,15 @@ void vpl_renderer::set_bg_color(const DirectX::XMVECTOR& color)
 void vpl_renderer::set_remap(const color& color)
 {
 	_states.remap_color = { static_cast<float>(color.r),static_cast<float>(color.g), static_cast<float>(color.b),1.0f };
+
+	//the ui sets the remap every frame, the table is only uploaded when it differs
+	refresh_palette();
 }
 
 void vpl_renderer::set_extra_light(const float extra)
 {
 	_states.canvas_dimension_extralight.vector4_f32[2] = extra;
+	refresh_palette();
 }
 
 bool vpl_renderer::hardware_processing() const
@@ -2007,6 +2457,11 @@ DirectX::XMVECTOR vpl_renderer::get_remap() const
 	return _states.remap_color;
 }
 
+float vpl_renderer::get_extra_light() const
+{
+	return _states.canvas_dimension_extralight.vector4_f32[2];
+}
+
 void d3d12_swapchain::discard()
 {
 	desc = { 0 };
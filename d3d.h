@@ -2,6 +2,12 @@
 
 #include "general_headers.h"
 #include "com_ptr.hpp"
+#include "frame.h"
+#include "pal.h"
+#include "hva_animation.h"
+#include "render_stats.h"
+
+#include <functional>
 
 #include <d3d12.h>
 #include "d3dx12.h"
@@ -43,13 +49,16 @@ struct d3d12_render_target_set
 	com_ptr<ID3D12DescriptorHeap> rtv_table;
 	com_ptr<ID3D12Resource> depth;
 	com_ptr<ID3D12DescriptorHeap> ds_heap;
+	size_t slices{ 1 };
 
 	void discard();
 	bool valid() const;
+	//view of a single array slice, only created when there is more than one
+	D3D12_CPU_DESCRIPTOR_HANDLE slice_view(const size_t target, const size_t slice) const;
 
 	~d3d12_render_target_set() = default;
 	bool initailize(com_ptr<ID3D12Device> device, const size_t number_of_targets,
-		const DXGI_FORMAT format, const size_t width, const size_t height);
+		const DXGI_FORMAT format, const size_t width, const size_t height, const size_t array_size = 1);
 };
 
 struct d3d12_swapchain
@@ -130,9 +139,16 @@ struct vxl_cbuffer_data
 	DirectX::XMVECTOR remap_color{ 252.0f,0.0f,0.0f,1.0f };
 	float section_buffer_size{ 0 };
 protected:
-	byte _padding[108];
+	float _shadow_alignment[3]{ 0 };
+public:
+	//world of the flattened shadow, used by the single pass shadow pipeline
+	DirectX::XMMATRIX shadow_transformation{ DirectX::XMMatrixIdentity() };
+protected:
+	byte _padding[32];
 };
 
+static_assert(sizeof(vxl_cbuffer_data) == 256u, "hva constant buffer must stay 256 bytes.");
+
 struct renderer_state_data
 {
 	DirectX::XMMATRIX world{ DirectX::XMMatrixIdentity() };
@@ -186,6 +202,8 @@ public:
 #endif
 	static const DXGI_FORMAT vpl_data_format = DXGI_FORMAT_R8_UINT;
 	static const DXGI_FORMAT palette_data_format = DXGI_FORMAT_R8_UINT;
+	//the compute path table, then the box path table, 3 channels of 256 entries each
+	static const size_t palette_texture_width = 2 * 3 * 256;
 	static const size_t normal_upload_buffer_idx = 0;
 	static const size_t hva_constants_upload_buffer_idx = 1;
 	static const size_t clear_target_buffer_idx = 2;
@@ -205,6 +223,8 @@ public:
 	bool load_vxl(const class vxl& vxl, const class hva& hva, const size_t frame, const bool clear = false);
 	bool reload_hva(const class hva* hva[], const size_t frame[], const float prerotation[], const float offsets[], const size_t numhvas);
 	bool load_vpl(const class vpl& vpl);
+	//uploads the dirty ranges of the vpl only, the caller clears them afterwards
+	bool update_vpl(const class vpl& vpl);
 	bool load_pal(const class palette& pal);
 	void clear_vxl_resources();
 	bool init_pipeline_state();
@@ -220,6 +240,8 @@ public:
 	bool vxl_resource_initiated() const;
 	bool bind_resource_table(const int resource_idx);
 	bool render_loaded_vxl();
+	//color and shadow coverage from one pass, the shadow is drawn with shadow_world instead of the world
+	bool render_loaded_vxl_with_shadow(const DirectX::XMMATRIX& shadow_world, cropped_frame& color, cropped_frame& shadow);
 	bool render_temp_screenshot(const size_t width, const size_t height, std::vector<byte>& output);
 	
 	bool render_gui(const bool clear_target = false);
@@ -242,15 +264,39 @@ public:
 	DirectX::XMVECTOR get_scale_factor() const;
 	DirectX::XMVECTOR get_bg_color() const;
 	DirectX::XMVECTOR get_remap() const;
+	float get_extra_light() const;
 	std::vector<byte> front_buffer_data();
 	std::vector<byte> render_target_data();
+	//tight bounds are found while reading back, only the visible pixels are kept
+	cropped_frame render_target_frame();
+
+	//counters of the last render, the coverage is filled in when its frame is read back
+	const render_stats& last_render_stats() const;
+	//every render since the last reset, one batch job in total
+	const render_stats& batch_stats() const;
+	void reset_batch_stats();
 
 private:
+	using readback_handler = std::function<void(const byte* mapped_data, const size_t row_pitch, const size_t width, const size_t height)>;
+
 	std::vector<byte> download_buffer(const D3D12_RESOURCE_STATES prev_state, com_ptr<ID3D12Resource> target, const DXGI_FORMAT download_fmt, const size_t ele_size);
+	bool read_back(const D3D12_RESOURCE_STATES prev_state, com_ptr<ID3D12Resource> target, const DXGI_FORMAT download_fmt, const size_t ele_size, const readback_handler& handler, const size_t subresource = 0);
+	//palette texture of the current remap and extra light, lit on the cpu for both paths
+	bool upload_palette();
+	//uploads again only when the remap or the extra light differ from the last upload
+	void refresh_palette();
+	color current_remap() const;
+	//pipeline statistics and occlusion around one draw, read after the draw has completed
+	bool create_statistics_queries();
+	void begin_statistics();
+	void end_statistics();
+	void read_statistics(render_stats& stats);
+	void record_stats(const render_stats& stats);
+	void record_coverage(const uint64_t pixels);
 	
 	com_ptr<ID3D12Device> _device;
 	com_ptr<ID3D12CommandQueue> _general_queue;
-	com_ptr<ID3D12PipelineState> _pso, _render_pso,_box_pso;
+	com_ptr<ID3D12PipelineState> _pso, _render_pso,_box_pso, _box_shadow_pso;
 	com_ptr<ID3D12RootSignature> _root_signature;
 	
 	//com_ptr<ID3D12DescriptorHeap> _uavs;
@@ -268,11 +314,21 @@ private:
 	d3d12_resource_set _upload_buffers;
 	d3d12_resource_set _vertex_buffer;
 	d3d12_resource_set _pixel_const_buffer;
+	d3d12_render_target_set _shadow_pass_targets;
 	std::vector<vxl_cbuffer_data> _hva_buffer_storage;
+	//one per load_vxl call, in the order of the hvas given to reload_hva
+	std::vector<hva_animation> _animations;
 	d3d12_fence _general_fence;
+	com_ptr<ID3D12QueryHeap> _statistics_queries, _occlusion_queries;
+	com_ptr<ID3D12Resource> _query_readback;
+	render_stats _last_stats, _batch_stats;
 	bool _renderer_resource_dirty = { false };
 	bool _box_rendered = { false };
 	bool _hardware_processing = { false };
+	//the remap tables come from this copy, uploaded again only when the remap or the extra light change
+	palette _palette;
+	color _uploaded_remap;
+	float _uploaded_extra_light = 0.0f;
 
 	//IMGUI STUFF
 	com_ptr<ID3D12DescriptorHeap> _gui_descriptor_heaps;
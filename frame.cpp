@@ -0,0 +1,282 @@
+#include "frame.h"
+#include "log.h"
+#include "profiler.h"
+
+#include "stb_includer.h"
+
+bool frame_rect::empty() const
+{
+	return !width || !height;
+}
+
+frame_rect frame_rect::united(const frame_rect& rhs) const
+{
+	if (empty())
+		return rhs;
+	if (rhs.empty())
+		return *this;
+
+	const uint32_t left = std::min(x, rhs.x);
+	const uint32_t top = std::min(y, rhs.y);
+	const uint32_t right = std::max(x + width, rhs.x + rhs.width);
+	const uint32_t bottom = std::max(y + height, rhs.y + rhs.height);
+	return { left, top, right - left, bottom - top };
+}
+
+cropped_frame cropped_frame::from_rows(const byte* rows, const size_t row_pitch, const size_t width, const size_t height)
+{
+	cropped_frame frame;
+	if (!rows || !width || !height)
+		return frame;
+
+	//alpha is the last byte of every pixel
+	static constexpr const uint32_t alpha_mask = 0xff000000u;
+	size_t left = width, right = 0, top = height, bottom = 0;
+
+	for (size_t y = 0; y < height; y++)
+	{
+		const uint32_t* row = reinterpret_cast<const uint32_t*>(rows + y * row_pitch);
+
+		size_t first = 0;
+		while (first < width && !(row[first] & alpha_mask))
+			first++;
+
+		if (first == width)
+			continue;
+
+		//only the part beyond the current right edge can move it
+		size_t last = width - 1;
+		while (last > right && !(row[last] & alpha_mask))
+			last--;
+
+		left = std::min(left, first);
+		right = std::max(right, last);
+		top = std::min(top, y);
+		bottom = y;
+	}
+
+	frame._canvas_width = width;
+	frame._canvas_height = height;
+
+	if (top == height)
+		return frame;
+
+	frame._bounds = { static_cast<uint32_t>(left), static_cast<uint32_t>(top),
+		static_cast<uint32_t>(right - left + 1), static_cast<uint32_t>(bottom - top + 1) };
+
+	const size_t crop_pitch = frame._bounds.width * channels;
+	frame._pixels.resize(crop_pitch * frame._bounds.height);
+	for (size_t y = 0; y < frame._bounds.height; y++)
+		memcpy(&frame._pixels[y * crop_pitch], rows + (top + y) * row_pitch + left * channels, crop_pitch);
+
+	return frame;
+}
+
+cropped_frame cropped_frame::from_canvas(const std::vector<byte>& canvas, const size_t width, const size_t height, const frame_rect& bounds)
+{
+	cropped_frame frame;
+	if (canvas.size() < width * height * channels || bounds.x + bounds.width > width || bounds.y + bounds.height > height)
+		return frame;
+
+	frame._canvas_width = width;
+	frame._canvas_height = height;
+	frame._bounds = bounds.empty() ? frame_rect() : bounds;
+
+	const size_t src_pitch = width * channels;
+	const size_t crop_pitch = frame._bounds.width * channels;
+	frame._pixels.resize(crop_pitch * frame._bounds.height);
+	for (size_t y = 0; y < frame._bounds.height; y++)
+		memcpy(&frame._pixels[y * crop_pitch], &canvas[(bounds.y + y) * src_pitch + bounds.x * channels], crop_pitch);
+
+	return frame;
+}
+
+bool cropped_frame::valid() const
+{
+	return _canvas_width && _canvas_height;
+}
+
+bool cropped_frame::empty() const
+{
+	return _bounds.empty();
+}
+
+const frame_rect& cropped_frame::bounds() const
+{
+	return _bounds;
+}
+
+size_t cropped_frame::canvas_width() const
+{
+	return _canvas_width;
+}
+
+size_t cropped_frame::canvas_height() const
+{
+	return _canvas_height;
+}
+
+const std::vector<byte>& cropped_frame::pixels() const
+{
+	return _pixels;
+}
+
+std::vector<byte> cropped_frame::expand() const
+{
+	std::vector<byte> canvas(_canvas_width * _canvas_height * channels, 0u);
+
+	const size_t dst_pitch = _canvas_width * channels;
+	const size_t crop_pitch = _bounds.width * channels;
+	for (size_t y = 0; y < _bounds.height; y++)
+		memcpy(&canvas[(_bounds.y + y) * dst_pitch + _bounds.x * channels], &_pixels[y * crop_pitch], crop_pitch);
+
+	return canvas;
+}
+
+bool cropped_frame::write_png(const std::filesystem::path& path) const
+{
+	PROFILE_SCOPE("cropped_frame::write_png");
+	if (!valid())
+		return false;
+
+	//png cannot be empty, an invisible frame is written as a single transparent pixel
+	if (empty())
+	{
+		const byte transparent[channels] = { 0 };
+		return stbi_write_png(path.string().c_str(), 1, 1, channels, transparent, 0);
+	}
+
+	return stbi_write_png(path.string().c_str(), _bounds.width, _bounds.height, channels, _pixels.data(), 0);
+}
+
+bool cropped_frame::write(std::ostream& output) const
+{
+	const uint32_t canvas[] = { static_cast<uint32_t>(_canvas_width), static_cast<uint32_t>(_canvas_height) };
+	output.write(reinterpret_cast<const char*>(canvas), sizeof canvas);
+	output.write(reinterpret_cast<const char*>(&_bounds), sizeof _bounds);
+	output.write(reinterpret_cast<const char*>(_pixels.data()), _pixels.size());
+	return !!output;
+}
+
+bool cropped_frame::read(std::istream& input)
+{
+	uint32_t canvas[2] = { 0 };
+	frame_rect bounds;
+	input.read(reinterpret_cast<char*>(canvas), sizeof canvas);
+	input.read(reinterpret_cast<char*>(&bounds), sizeof bounds);
+
+	//compared by subtraction so a hostile entry cannot wrap around the canvas
+	if (!input || !canvas[0] || !canvas[1] || canvas[0] > max_canvas_size || canvas[1] > max_canvas_size ||
+		bounds.x > canvas[0] || bounds.width > canvas[0] - bounds.x || bounds.y > canvas[1] || bounds.height > canvas[1] - bounds.y)
+		return false;
+
+	//the pixels have to be there before they are allocated
+	const size_t pixel_size = static_cast<size_t>(bounds.width) * bounds.height * channels;
+	const auto pixels_start = input.tellg();
+	input.seekg(0, std::ios::end);
+	const auto stream_end = input.tellg();
+	input.seekg(pixels_start);
+	if (pixels_start < 0 || stream_end < pixels_start || static_cast<uint64_t>(stream_end - pixels_start) < pixel_size)
+		return false;
+
+	std::vector<byte> pixels(pixel_size);
+	input.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+	if (static_cast<size_t>(input.gcount()) != pixels.size())
+		return false;
+
+	_canvas_width = canvas[0];
+	_canvas_height = canvas[1];
+	_bounds = bounds;
+	_pixels = std::move(pixels);
+	return true;
+}
+
+hash128 cropped_frame::digest() const
+{
+	return hash_builder()
+		.append(_canvas_width)
+		.append(_canvas_height)
+		.append(_bounds)
+		.append(_pixels)
+		.finish();
+}
+
+size_t cropped_frame::visible_pixels() const
+{
+	size_t visible = 0;
+	for (size_t i = channels - 1; i < _pixels.size(); i += channels)
+		visible += _pixels[i] != 0;
+
+	return visible;
+}
+
+void frame_table::clear()
+{
+	_canvas_width = _canvas_height = 0;
+	_frames.clear();
+	_references.clear();
+	_stored.clear();
+}
+
+void frame_table::add(const size_t index, const cropped_frame& frame)
+{
+	_canvas_width = frame.canvas_width();
+	_canvas_height = frame.canvas_height();
+	_frames.emplace_back(index, frame.bounds());
+}
+
+void frame_table::add(const size_t index, const cropped_frame& frame, const hash128& digest)
+{
+	add(index, frame);
+	_stored.emplace(digest, index);
+}
+
+void frame_table::add_reference(const size_t index, const size_t stored_index)
+{
+	_references.emplace_back(index, stored_index);
+}
+
+size_t frame_table::find(const hash128& digest) const
+{
+	const auto stored = _stored.find(digest);
+	return stored != _stored.end() ? stored->second : npos;
+}
+
+size_t frame_table::stored_count() const
+{
+	return _frames.size();
+}
+
+size_t frame_table::reference_count() const
+{
+	return _references.size();
+}
+
+bool frame_table::save(const std::filesystem::path& path) const
+{
+	std::ofstream output(path.string());
+	if (!output)
+	{
+		LOG(ERROR) << "Failed to write frame table to " << path.string() << ".\n";
+		return false;
+	}
+
+	output << "[Canvas]\n";
+	output << "Width=" << _canvas_width << "\n";
+	output << "Height=" << _canvas_height << "\n\n";
+
+	//index=x,y,width,height
+	output << "[Frames]\n";
+	for (const auto& [index, rect] : _frames)
+		output << index << "=" << rect.x << "," << rect.y << "," << rect.width << "," << rect.height << "\n";
+
+	//index=stored index, the image of the stored frame is reused
+	if (!_references.empty())
+	{
+		output << "\n[References]\n";
+		for (const auto& [index, stored_index] : _references)
+			output << index << "=" << stored_index << "\n";
+	}
+
+	return true;
+}
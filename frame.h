@@ -0,0 +1,81 @@
+#pragma once
+
+#include "general_headers.h"
+#include "hash.h"
+
+//a rectangle on a rendered canvas, in pixels
+struct frame_rect
+{
+	uint32_t x{ 0 }, y{ 0 };
+	uint32_t width{ 0 }, height{ 0 };
+
+	bool empty() const;
+	frame_rect united(const frame_rect& rhs) const;
+};
+
+//a rendered frame holding only the pixels inside its tight bounds
+//the bounds work like the offsets in a shp frame header
+class cropped_frame
+{
+public:
+	static constexpr const size_t channels = 4u;
+
+	cropped_frame() = default;
+	~cropped_frame() = default;
+
+	//scan the alpha of a mapped rgba surface and keep the visible part only
+	static cropped_frame from_rows(const byte* rows, const size_t row_pitch, const size_t width, const size_t height);
+	//wrap a full canvas, keeping the pixels inside bounds
+	static cropped_frame from_canvas(const std::vector<byte>& canvas, const size_t width, const size_t height, const frame_rect& bounds);
+
+	bool valid() const;
+	bool empty() const;
+	const frame_rect& bounds() const;
+	size_t canvas_width() const;
+	size_t canvas_height() const;
+	const std::vector<byte>& pixels() const;
+	//identical frames on the same canvas share the same digest
+	hash128 digest() const;
+	//pixels with a non zero alpha
+	size_t visible_pixels() const;
+
+	//rebuild the full canvas, transparent outside the bounds
+	std::vector<byte> expand() const;
+	bool write_png(const std::filesystem::path& path) const;
+
+	//raw form used by the render cache
+	bool write(std::ostream& output) const;
+	bool read(std::istream& input);
+
+private:
+	//the largest 2d texture direct3d 12 creates, a stored canvas beyond it is corrupt
+	static constexpr const uint32_t max_canvas_size = 16384u;
+
+	size_t _canvas_width{ 0 }, _canvas_height{ 0 };
+	frame_rect _bounds;
+	std::vector<byte> _pixels;
+};
+
+//every exported frame with its offsets, saved next to the images as an ini file
+//a duplicated frame is stored once and referenced by the later indices
+class frame_table
+{
+public:
+	static constexpr const size_t npos = static_cast<size_t>(-1);
+
+	void clear();
+	void add(const size_t index, const cropped_frame& frame);
+	void add(const size_t index, const cropped_frame& frame, const hash128& digest);
+	void add_reference(const size_t index, const size_t stored_index);
+	//index of a stored frame with the same digest, npos if there is none
+	size_t find(const hash128& digest) const;
+	size_t stored_count() const;
+	size_t reference_count() const;
+	bool save(const std::filesystem::path& path) const;
+
+private:
+	size_t _canvas_width{ 0 }, _canvas_height{ 0 };
+	std::vector<std::pair<size_t, frame_rect>> _frames;
+	std::vector<std::pair<size_t, size_t>> _references;
+	std::unordered_map<hash128, size_t> _stored;
+};
@@ -0,0 +1,174 @@
+#include "frame_schedule.h"
+#include "hash.h"
+#include "log.h"
+
+bool frame_schedule::plan(const hva* const hvas[], const size_t numhvas, const bool collapse)
+{
+	clear();
+	if (!hvas || !numhvas)
+		return false;
+
+	//hvas without frames stay on frame 0
+	size_t cycle = 1;
+	for (size_t i = 0; i < numhvas; i++)
+	{
+		if (!hvas[i])
+			return false;
+		cycle = lcm(cycle, std::max(hvas[i]->frame_count(), static_cast<size_t>(1u)));
+	}
+
+	std::vector<std::vector<size_t>> same_frames(numhvas);
+	if (collapse)
+	{
+		for (size_t i = 0; i < numhvas; i++)
+			same_frames[i] = first_same_frames(*hvas[i]);
+	}
+
+	_hva_count = numhvas;
+	_frames.resize(cycle * numhvas);
+	_sources.resize(cycle);
+
+	std::unordered_map<hash128, size_t> poses;
+	std::vector<size_t> pose(numhvas);
+	for (size_t step = 0; step < cycle; step++)
+	{
+		for (size_t i = 0; i < numhvas; i++)
+		{
+			const size_t frame = step % std::max(hvas[i]->frame_count(), static_cast<size_t>(1u));
+			_frames[step * numhvas + i] = frame;
+			pose[i] = frame < same_frames[i].size() ? same_frames[i][frame] : frame;
+		}
+
+		_sources[step] = step;
+		if (collapse)
+		{
+			const auto inserted = poses.emplace(murmur3_128(pose.data(), pose.size() * sizeof(size_t)), step);
+			if (!inserted.second)
+			{
+				_sources[step] = inserted.first->second;
+				continue;
+			}
+		}
+
+		_rendered++;
+	}
+
+	return true;
+}
+
+void frame_schedule::clear()
+{
+	_hva_count = 0;
+	_rendered = 0;
+	_frames.clear();
+	_sources.clear();
+}
+
+size_t frame_schedule::hva_count() const
+{
+	return _hva_count;
+}
+
+size_t frame_schedule::cycle_length() const
+{
+	return _sources.size();
+}
+
+size_t frame_schedule::rendered_count() const
+{
+	return _rendered;
+}
+
+const size_t* frame_schedule::frames(const size_t step) const
+{
+	return step < cycle_length() ? &_frames[step * _hva_count] : nullptr;
+}
+
+size_t frame_schedule::source(const size_t step) const
+{
+	return step < cycle_length() ? _sources[step] : npos;
+}
+
+bool frame_schedule::is_rendered(const size_t step) const
+{
+	return source(step) == step;
+}
+
+bool frame_schedule::save(const std::filesystem::path& path) const
+{
+	std::ofstream output(path);
+	if (!output)
+	{
+		LOG(ERROR) << "Failed to write frame schedule " << path.string() << ".\n";
+		return false;
+	}
+
+	output << "[Schedule]\n";
+	output << "Cycle=" << cycle_length() << "\n";
+	output << "Rendered=" << rendered_count() << "\n\n";
+
+	//step=frames of every hva, then the step whose image it reuses
+	output << "[Steps]\n";
+	for (size_t step = 0; step < cycle_length(); step++)
+	{
+		output << step << "=";
+		for (size_t i = 0; i < _hva_count; i++)
+			output << (i ? "," : "") << frames(step)[i];
+		if (!is_rendered(step))
+			output << "," << source(step);
+		output << "\n";
+	}
+
+	return !!output;
+}
+
+size_t frame_schedule::gcd(size_t a, size_t b)
+{
+	while (b)
+	{
+		const size_t r = a % b;
+		a = b;
+		b = r;
+	}
+
+	return a;
+}
+
+size_t frame_schedule::lcm(const size_t a, const size_t b)
+{
+	return (a && b) ? a / gcd(a, b) * b : 0;
+}
+
+std::vector<size_t> frame_schedule::first_same_frames(const hva& hva)
+{
+	std::vector<size_t> result(hva.frame_count());
+	if (!hva.is_loaded())
+		return result;
+
+	//frames of a compact hva already share their unique index
+	const size_t frame_bytes = hva.section_count() * sizeof(vxlmatrix);
+	std::unordered_map<hash128, std::vector<size_t>> known;
+	std::vector<size_t> first_of_unique(hva.unique_frame_count(), npos);
+	for (size_t f = 0; f < result.size(); f++)
+	{
+		size_t& first = first_of_unique[hva.frame_index(f)];
+		if (first != npos)
+		{
+			result[f] = first;
+			continue;
+		}
+
+		const vxlmatrix* block = hva.matrix(f, 0);
+		auto& candidates = known[murmur3_128(block, frame_bytes)];
+		const auto same = std::find_if(candidates.begin(), candidates.end(), [&](const size_t other) {
+			return !memcmp(hva.matrix(other, 0), block, frame_bytes);
+		});
+
+		first = same != candidates.end() ? *same : f;
+		if (first == f)
+			candidates.push_back(f);
+		result[f] = first;
+	}
+
+	return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "hva.h"
+
+//output frames of one direction when every hva loops its own frame count
+//the cycle is the lcm of the counts, a step whose matrices were already shown reuses the earlier image
+class frame_schedule
+{
+public:
+	static constexpr const size_t npos = static_cast<size_t>(-1);
+
+	frame_schedule() = default;
+	~frame_schedule() = default;
+
+	//collapse compares the matrices of every frame once per hva, steps with the same pose share their first step
+	bool plan(const hva* const hvas[], const size_t numhvas, const bool collapse = true);
+	void clear();
+
+	size_t hva_count() const;
+	size_t cycle_length() const;
+	size_t rendered_count() const;
+
+	//frame of every hva at a step
+	const size_t* frames(const size_t step) const;
+	//first step with the same pose, the step itself when it has to be rendered
+	size_t source(const size_t step) const;
+	bool is_rendered(const size_t step) const;
+
+	//every step with its frames and source, for inspection
+	bool save(const std::filesystem::path& path) const;
+
+	static size_t gcd(size_t a, size_t b);
+	static size_t lcm(const size_t a, const size_t b);
+
+private:
+	//first frame of the hva holding the same matrices as each frame
+	static std::vector<size_t> first_same_frames(const hva& hva);
+
+	size_t _hva_count = 0;
+	size_t _rendered = 0;
+	std::vector<size_t> _frames;
+	std::vector<size_t> _sources;
+};
@@ -238,6 +238,11 @@ bool vxl_gdi_renderer::render_vxl(const vxl& vxl, const hva& hva, const palette&
 	if (!valid() || !vxl.is_loaded() || !hva.is_loaded() || !palette.is_loaded() || vxl.limb_count() != hva.section_count())
 		return false;
 
+	render_stats stats;
+	stats.renders = 1;
+	stats.faces_culled = true;
+	stats.depth_rejects_exact = true;
+
 	const color& clear_color = palette.entry()[0];
 	clear_vxl_canvas({ clear_color.b,clear_color.g,clear_color.r,255u });
 	const size_t drawing_frame = frame >= hva.frame_count() ? 0 : frame;
@@ -316,10 +321,15 @@ bool vxl_gdi_renderer::render_vxl(const vxl& vxl, const hva& hva, const palette&
 					if (!vox.color)
 						continue;
 
+					stats.voxels_submitted++;
+					stats.primitives_submitted++;
 					auto normal = game_normals[vox.normal];
 					auto transformed_normal = DirectX::XMVector4Transform(normal, normal_transform);
 					if (DirectX::XMVector4Dot(transformed_normal, camera_dir).vector4_f32[0] < 0.0f)
+					{
+						stats.backface_culled++;
 						continue;
+					}
 
 					DirectX::XMVECTOR vox_pos = { static_cast<float>(x),static_cast<float>(y),static_cast<float>(z),0.0f };
 					DirectX::XMVECTOR model_pos = transformed_base + x * transformed_x + y * transformed_y + z * transformed_z;
@@ -329,10 +339,22 @@ bool vxl_gdi_renderer::render_vxl(const vxl& vxl, const hva& hva, const palette&
 					const size_t buffery = static_cast<size_t>(screen_pos.y);
 
 					if (screen_pos.x >= bitmap_width || screen_pos.x < 0 || screen_pos.y >= bitmap_height || screen_pos.y < 0)
+					{
+						stats.off_canvas++;
 						continue;
+					}
 
-					if (screen_pos.z >= _zbuffer[buffery][bufferx])
+					double& depth = _zbuffer[buffery][bufferx];
+					if (screen_pos.z >= depth)
+					{
+						stats.depth_rejected++;
 						continue;
+					}
+
+					if (depth == std::numeric_limits<double>::max())
+						stats.pixels_covered++;
+					depth = screen_pos.z;
+					stats.pixels_written++;
 
 					size_t vpl_table_idx = vpl_reindex_table[vox.normal];
 					const color& real_color = palette.entry()[vpl.data()[vpl_table_idx][vox.color]];
@@ -345,6 +367,7 @@ bool vxl_gdi_renderer::render_vxl(const vxl& vxl, const hva& hva, const palette&
 		}
 	}
 
+	_last_stats = stats;
 	return true;
 }
 
@@ -375,3 +398,8 @@ DirectX::XMVECTOR vxl_gdi_renderer::get_light_dir() const
 {
 	return _states.light;
 }
+
+const render_stats& vxl_gdi_renderer::last_stats() const
+{
+	return _last_stats;
+}
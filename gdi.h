@@ -1,6 +1,7 @@
 #pragma once
 
 #include "general_headers.h"
+#include "render_stats.h"
 
 namespace deleters
 {
@@ -97,6 +98,8 @@ public:
 	void set_light_dir(const DirectX::XMVECTOR& dir);
 	DirectX::XMMATRIX get_world()const;
 	DirectX::XMVECTOR get_light_dir()const;
+	//counters of the last render_vxl call
+	const render_stats& last_stats()const;
 
 private:
 	safe_bitmap _canvas;
@@ -104,4 +107,5 @@ private:
 	void* _surface_buffer{ 0 };
 	std::unique_ptr<double[][bitmap_width]> _zbuffer;
 	scene_states _states;
+	render_stats _last_stats;
 };
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "hash.h"
+
+namespace
+{
+	inline uint64_t rotl64(const uint64_t x, const int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t fmix64(uint64_t k)
+	{
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdull;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ull;
+		k ^= k >> 33;
+		return k;
+	}
+
+	inline uint64_t read_block(const byte* data)
+	{
+		uint64_t block = 0;
+		memcpy(&block, data, sizeof block);
+		return block;
+	}
+
+	constexpr const uint64_t c1 = 0x87c37b91114253d5ull;
+	constexpr const uint64_t c2 = 0x4cf5ad432745937full;
+
+	inline void mix_block(uint64_t& h1, uint64_t& h2, const byte* block)
+	{
+		uint64_t k1 = read_block(block);
+		uint64_t k2 = read_block(block + 8u);
+
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+}
+
+hash128 murmur3_128(const void* data, const size_t size, const uint32_t seed)
+{
+	return hash_builder(seed).append(data, size).finish();
+}
+
+std::string to_string(const hash128& digest)
+{
+	static constexpr const char digits[] = "0123456789abcdef";
+
+	std::string result(32u, '0');
+	for (size_t i = 0; i < 16u; i++)
+	{
+		result[15u - i] = digits[(digest.high >> (i * 4u)) & 0xfu];
+		result[31u - i] = digits[(digest.low >> (i * 4u)) & 0xfu];
+	}
+	return result;
+}
+
+hash_builder::hash_builder(const uint32_t seed) :_h1(seed), _h2(seed)
+{
+}
+
+hash_builder& hash_builder::append(const void* data, const size_t size)
+{
+	if (!data || !size)
+		return *this;
+
+	const byte* bytes = reinterpret_cast<const byte*>(data);
+	size_t remained = size;
+	_size += size;
+
+	//complete the block left over by the previous input first
+	if (_tail_size)
+	{
+		const size_t taken = std::min(_tail.size() - _tail_size, remained);
+		memcpy(_tail.data() + _tail_size, bytes, taken);
+		_tail_size += taken;
+		bytes += taken;
+		remained -= taken;
+
+		if (_tail_size < _tail.size())
+			return *this;
+
+		mix_block(_h1, _h2, _tail.data());
+		_tail_size = 0;
+	}
+
+	for (; remained >= 16u; bytes += 16u, remained -= 16u)
+		mix_block(_h1, _h2, bytes);
+
+	memcpy(_tail.data(), bytes, remained);
+	_tail_size = remained;
+	return *this;
+}
+
+hash128 hash_builder::finish() const
+{
+	uint64_t h1 = _h1, h2 = _h2;
+
+	//tail
+	const byte* tail = _tail.data();
+	uint64_t k1 = 0, k2 = 0;
+	switch (_tail_size)
+	{
+	case 15: k2 ^= static_cast<uint64_t>(tail[14]) << 48; [[fallthrough]];
+	case 14: k2 ^= static_cast<uint64_t>(tail[13]) << 40; [[fallthrough]];
+	case 13: k2 ^= static_cast<uint64_t>(tail[12]) << 32; [[fallthrough]];
+	case 12: k2 ^= static_cast<uint64_t>(tail[11]) << 24; [[fallthrough]];
+	case 11: k2 ^= static_cast<uint64_t>(tail[10]) << 16; [[fallthrough]];
+	case 10: k2 ^= static_cast<uint64_t>(tail[9]) << 8; [[fallthrough]];
+	case 9: k2 ^= static_cast<uint64_t>(tail[8]);
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		[[fallthrough]];
+	case 8: k1 ^= static_cast<uint64_t>(tail[7]) << 56; [[fallthrough]];
+	case 7: k1 ^= static_cast<uint64_t>(tail[6]) << 48; [[fallthrough]];
+	case 6: k1 ^= static_cast<uint64_t>(tail[5]) << 40; [[fallthrough]];
+	case 5: k1 ^= static_cast<uint64_t>(tail[4]) << 32; [[fallthrough]];
+	case 4: k1 ^= static_cast<uint64_t>(tail[3]) << 24; [[fallthrough]];
+	case 3: k1 ^= static_cast<uint64_t>(tail[2]) << 16; [[fallthrough]];
+	case 2: k1 ^= static_cast<uint64_t>(tail[1]) << 8; [[fallthrough]];
+	case 1: k1 ^= static_cast<uint64_t>(tail[0]);
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		break;
+	default:
+		break;
+	}
+
+	//finalization
+	h1 ^= _size; h2 ^= _size;
+	h1 += h2; h2 += h1;
+	h1 = fmix64(h1); h2 = fmix64(h2);
+	h1 += h2; h2 += h1;
+
+	return { h1, h2 };
+}
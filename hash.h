@@ -0,0 +1,58 @@
+#pragma once
+
+#include "general_headers.h"
+
+#include <array>
+
+//128 bit digest, murmurhash3 x64 variant
+struct hash128
+{
+	uint64_t low{ 0 }, high{ 0 };
+
+	bool operator==(const hash128& rhs) const = default;
+};
+
+template<>
+struct std::hash<hash128>
+{
+	size_t operator()(const hash128& digest) const noexcept
+	{
+		return static_cast<size_t>(digest.low ^ (digest.high * 0x9e3779b97f4a7c15ull));
+	}
+};
+
+hash128 murmur3_128(const void* data, const size_t size, const uint32_t seed = 0u);
+//32 hex digits, high part first
+std::string to_string(const hash128& digest);
+
+//hashes several inputs as one block, whole 16 byte blocks are mixed as they arrive and only the rest is kept
+class hash_builder
+{
+public:
+	explicit hash_builder(const uint32_t seed = 0u);
+
+	hash_builder& append(const void* data, const size_t size);
+
+	template<typename T>
+	hash_builder& append(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "only plain data can be hashed by bytes.");
+		return append(&value, sizeof value);
+	}
+
+	template<typename T>
+	hash_builder& append(const std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "only plain data can be hashed by bytes.");
+		append(values.size());
+		return append(values.data(), values.size() * sizeof(T));
+	}
+
+	hash128 finish() const;
+
+private:
+	uint64_t _h1 = 0, _h2 = 0;
+	size_t _size = 0;
+	std::array<byte, 16> _tail = {};
+	size_t _tail_size = 0;
+};
@@ -1,4 +1,55 @@
 #include "hva.h"
+#include "hash.h"
+#include "log.h"
+#include "profiler.h"
+
+#include <cmath>
+
+namespace
+{
+	constexpr const char compact_signature[16] = { 'H','V','A','C','O','M','P','A','C','T',' ',' ',' ',' ','0','1' };
+
+	//after the signature: the original signature, frame, section and unique frame counts, the rotation scale
+	struct compact_header
+	{
+		char signature[16]{ 0 };
+		uint32_t frame_count{ 0 };
+		uint32_t section_count{ 0 };
+		uint32_t unique_frame_count{ 0 };
+		float rotation_scale{ 1.0f };
+	};
+
+	//one matrix of a unique frame
+	struct compact_matrix
+	{
+		int16_t rotation[3][3]{ 0 };
+		float translation[3]{ 0 };
+	};
+
+	constexpr const float fixed_one = 32767.0f;
+
+	struct compact_storage
+	{
+		std::vector<char> names;
+		std::vector<vxlmatrix> matrices;
+		std::vector<uint32_t> frame_map;
+	};
+
+	//counts beyond these come from a corrupt header, nothing is sized from them
+	constexpr const uint32_t max_frames = 0x10000u;
+	constexpr const uint32_t max_sections = 0x400u;
+
+	bool plausible_counts(const uint32_t frames, const uint32_t sections)
+	{
+		return frames <= max_frames && sections <= max_sections;
+	}
+
+	size_t compact_size(const compact_header& header)
+	{
+		return sizeof compact_signature + sizeof header + header.section_count * 0x10u + header.frame_count * sizeof(uint32_t) +
+			static_cast<size_t>(header.unique_frame_count) * header.section_count * (sizeof(int16_t) * 9u + sizeof(float) * 3u);
+	}
+}
 
 hva::hva(const std::string& filename) :hva()
 {
@@ -7,8 +58,43 @@ hva::hva(const std::string& filename) :hva()
 
 bool hva::load(const std::string& filename)
 {
-	auto data = read_whole_file(filename);
-	return load(data.get());
+	PROFILE_SCOPE("hva::load");
+	purge();
+
+	//hva files are small, they are read and closed so the file is not locked while it is loaded
+	std::ifstream input(filename, std::ios::binary | std::ios::ate);
+	if (!input)
+	{
+		LOG(ERROR) << "Failed to open hva file " << filename << ".\n";
+		return false;
+	}
+
+	auto file = std::make_shared<std::vector<char>>(static_cast<size_t>(input.tellg()));
+	input.seekg(0);
+	if (!input.read(file->data(), file->size()))
+	{
+		LOG(ERROR) << "Failed to read hva file " << filename << ".\n";
+		return false;
+	}
+
+	const char* filedata = file->data();
+	if (is_compact(filedata, file->size()))
+	{
+		if (read_compact(filedata, file->size()))
+			return true;
+
+		LOG(ERROR) << "Compact hva file " << filename << " is truncated.\n";
+		return false;
+	}
+
+	if (!read_view(filedata, file->size()))
+	{
+		LOG(ERROR) << "Hva file " << filename << " is truncated.\n";
+		return false;
+	}
+
+	_storage = file;
+	return true;
 }
 
 bool hva::load(const void* data)
@@ -18,35 +104,275 @@ bool hva::load(const void* data)
 		return false;
 	}
 
-	char* filedata = reinterpret_cast<char*>(const_cast<void*>(data));
-	char* filecur = filedata;
-
 	purge();
 
+	//the size is unknown, the counts in the header decide how much is copied
+	const char* filedata = reinterpret_cast<const char*>(data);
+	if (is_compact(filedata, sizeof compact_signature))
+	{
+		compact_header header;
+		memcpy_s(&header, sizeof header, filedata + sizeof compact_signature, sizeof header);
+		if (!plausible_counts(header.frame_count, header.section_count) || header.unique_frame_count > header.frame_count)
+		{
+			LOG(ERROR) << "Compact hva header is corrupt.\n";
+			return false;
+		}
+		return read_compact(filedata, compact_size(header));
+	}
+
+	uint32_t counts[2] = { 0 };
+	memcpy_s(counts, sizeof counts, filedata + sizeof _signature, sizeof counts);
+	if (!plausible_counts(counts[0], counts[1]))
+	{
+		LOG(ERROR) << "Hva header is corrupt.\n";
+		return false;
+	}
+
+	const size_t filesize = sizeof _signature + sizeof counts + counts[1] * name_length + static_cast<size_t>(counts[0]) * counts[1] * sizeof(vxlmatrix);
+
+	auto copy = std::make_shared<std::vector<char>>(filedata, filedata + filesize);
+	if (!read_view(copy->data(), copy->size()))
+		return false;
+
+	_storage = copy;
+	return true;
+}
+
+bool hva::read_view(const char* data, const size_t size)
+{
+	const size_t header_size = sizeof _signature + sizeof _framecount + sizeof _sectioncount;
+	if (size < header_size)
+		return false;
+
+	const char* filecur = data;
 	memcpy_s(_signature, sizeof _signature, filecur, sizeof _signature);
 	filecur += sizeof _signature;
-	_framecount = *reinterpret_cast<uint32_t*>(filecur);
+	memcpy_s(&_framecount, sizeof _framecount, filecur, sizeof _framecount);
 	filecur += sizeof _framecount;
-	_sectioncount = *reinterpret_cast<uint32_t*>(filecur);
-	filecur += sizeof _sectioncount + /*section names*/section_count() * sizeof _signature;
+	memcpy_s(&_sectioncount, sizeof _sectioncount, filecur, sizeof _sectioncount);
+	filecur += sizeof _sectioncount;
 
-	size_t total_maxticx_count = section_count() * frame_count();
-	_totalmatrices.resize(total_maxticx_count);
-	memcpy_s(_totalmatrices.data(), total_maxticx_count * sizeof vxlmatrix, filecur, total_maxticx_count * sizeof vxlmatrix);
+	const size_t total_matrix_count = section_count() * frame_count();
+	if (!plausible_counts(_framecount, _sectioncount) || size < header_size + section_count() * name_length + total_matrix_count * sizeof(vxlmatrix))
+	{
+		_framecount = _sectioncount = 0;
+		return false;
+	}
+
+	_names = filecur;
+	_matrices = reinterpret_cast<const vxlmatrix*>(filecur + section_count() * name_length);
+	_unique_frames = frame_count();
+	index_names();
+	return true;
+}
+
+bool hva::is_compact(const char* data, const size_t size)
+{
+	return size >= sizeof compact_signature && !memcmp(data, compact_signature, sizeof compact_signature);
+}
+
+bool hva::read_compact(const char* data, const size_t size)
+{
+	compact_header header;
+	if (size < sizeof compact_signature + sizeof header)
+		return false;
+
+	memcpy_s(&header, sizeof header, data + sizeof compact_signature, sizeof header);
+	if (!plausible_counts(header.frame_count, header.section_count) || size < compact_size(header) || header.unique_frame_count > header.frame_count)
+		return false;
+
+	auto storage = std::make_shared<compact_storage>();
+	const char* filecur = data + sizeof compact_signature + sizeof header;
+	storage->names.assign(filecur, filecur + header.section_count * name_length);
+	filecur += header.section_count * name_length;
+
+	storage->frame_map.resize(header.frame_count);
+	memcpy_s(storage->frame_map.data(), storage->frame_map.size() * sizeof(uint32_t), filecur, header.frame_count * sizeof(uint32_t));
+	filecur += header.frame_count * sizeof(uint32_t);
+	for (const uint32_t unique : storage->frame_map)
+	{
+		if (unique >= header.unique_frame_count)
+			return false;
+	}
+
+	const float scale = header.rotation_scale / fixed_one;
+	storage->matrices.resize(static_cast<size_t>(header.unique_frame_count) * header.section_count);
+	for (auto& matrix : storage->matrices)
+	{
+		compact_matrix packed;
+		memcpy_s(packed.rotation, sizeof packed.rotation, filecur, sizeof packed.rotation);
+		filecur += sizeof packed.rotation;
+		memcpy_s(packed.translation, sizeof packed.translation, filecur, sizeof packed.translation);
+		filecur += sizeof packed.translation;
+
+		for (size_t r = 0; r < 3; r++)
+		{
+			for (size_t c = 0; c < 3; c++)
+				matrix._data[r][c] = packed.rotation[r][c] * scale;
+			matrix._data[r][3] = packed.translation[r];
+		}
+	}
+
+	memcpy_s(_signature, sizeof _signature, header.signature, sizeof header.signature);
+	_framecount = header.frame_count;
+	_sectioncount = header.section_count;
+	_names = storage->names.data();
+	_matrices = storage->matrices.data();
+	_frame_map = storage->frame_map.data();
+	_unique_frames = header.unique_frame_count;
+	_storage = storage;
+	index_names();
+	return true;
+}
+
+void hva::index_names()
+{
+	//the first section keeps a repeated name
+	_name_index.clear();
+	for (size_t i = 0; i < section_count(); i++)
+		_name_index.emplace(section_name(i), i);
+}
+
+size_t hva::unique_frame_count() const
+{
+	return _unique_frames;
+}
+
+size_t hva::frame_index(const size_t frame) const
+{
+	return _frame_map ? _frame_map[frame] : frame;
+}
+
+bool hva::save(const std::filesystem::path& path) const
+{
+	if (!is_loaded())
+		return false;
+
+	std::vector<char> image;
+	auto append = [&image](const void* data, const size_t size) {
+		const char* bytes = reinterpret_cast<const char*>(data);
+		image.insert(image.end(), bytes, bytes + size);
+	};
+
+	append(_signature, sizeof _signature);
+	append(&_framecount, sizeof _framecount);
+	append(&_sectioncount, sizeof _sectioncount);
+	append(_names, section_count() * name_length);
+	for (size_t f = 0; f < frame_count(); f++)
+		append(matrix(f, 0), section_count() * sizeof(vxlmatrix));
+
+	std::ofstream output(path, std::ios::binary);
+	output.write(image.data(), image.size());
+	if (!output)
+	{
+		LOG(ERROR) << "Failed to write hva file " << path.string() << ".\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool hva::save_compact(const std::filesystem::path& path) const
+{
+	if (!is_loaded())
+		return false;
+
+	//a frame is the block of its section matrices
+	const size_t frame_bytes = section_count() * sizeof(vxlmatrix);
+	std::unordered_map<hash128, std::vector<uint32_t>> known;
+	std::vector<uint32_t> frame_map(frame_count());
+	std::vector<size_t> unique_frames;
+	for (size_t f = 0; f < frame_count(); f++)
+	{
+		const vxlmatrix* frame = matrix(f, 0);
+		auto& candidates = known[murmur3_128(frame, frame_bytes)];
+
+		const auto same = std::find_if(candidates.begin(), candidates.end(), [&](const uint32_t unique) {
+			return !memcmp(matrix(unique_frames[unique], 0), frame, frame_bytes);
+		});
+
+		if (same != candidates.end())
+		{
+			frame_map[f] = *same;
+			continue;
+		}
+
+		frame_map[f] = static_cast<uint32_t>(unique_frames.size());
+		candidates.push_back(frame_map[f]);
+		unique_frames.push_back(f);
+	}
+
+	compact_header header;
+	memcpy_s(header.signature, sizeof header.signature, _signature, sizeof _signature);
+	header.frame_count = _framecount;
+	header.section_count = _sectioncount;
+	header.unique_frame_count = static_cast<uint32_t>(unique_frames.size());
+	header.rotation_scale = 0.0f;
+	for (const size_t f : unique_frames)
+	{
+		for (size_t s = 0; s < section_count(); s++)
+		{
+			const vxlmatrix& m = *matrix(f, s);
+			for (size_t r = 0; r < 3; r++)
+			{
+				for (size_t c = 0; c < 3; c++)
+					header.rotation_scale = std::max(header.rotation_scale, std::abs(m._data[r][c]));
+			}
+		}
+	}
+
+	if (header.rotation_scale == 0.0f)
+		header.rotation_scale = 1.0f;
+
+	std::ofstream output(path, std::ios::binary);
+	output.write(compact_signature, sizeof compact_signature);
+	output.write(reinterpret_cast<const char*>(&header), sizeof header);
+	output.write(_names, section_count() * name_length);
+	output.write(reinterpret_cast<const char*>(frame_map.data()), frame_map.size() * sizeof(uint32_t));
+
+	const float to_fixed = fixed_one / header.rotation_scale;
+	for (const size_t f : unique_frames)
+	{
+		for (size_t s = 0; s < section_count(); s++)
+		{
+			const vxlmatrix& m = *matrix(f, s);
+			compact_matrix packed;
+			for (size_t r = 0; r < 3; r++)
+			{
+				for (size_t c = 0; c < 3; c++)
+					packed.rotation[r][c] = static_cast<int16_t>(std::lround(std::clamp(m._data[r][c] * to_fixed, -fixed_one, fixed_one)));
+				packed.translation[r] = m._data[r][3];
+			}
+
+			output.write(reinterpret_cast<const char*>(packed.rotation), sizeof packed.rotation);
+			output.write(reinterpret_cast<const char*>(packed.translation), sizeof packed.translation);
+		}
+	}
+
+	if (!output)
+	{
+		LOG(ERROR) << "Failed to write compact hva file " << path.string() << ".\n";
+		return false;
+	}
 
 	return true;
 }
 
 bool hva::is_loaded() const
 {
-	return !_totalmatrices.empty();
+	return _matrices && section_count() && frame_count();
 }
 
 void hva::purge()
 {
 	_signature[0] = 0;
 	_framecount = _sectioncount = 0;
-	_totalmatrices.clear();
+	_names = nullptr;
+	_matrices = nullptr;
+	_frame_map = nullptr;
+	_unique_frames = 0;
+	_name_index.clear();
+	_storage.reset();
 }
 
 file_type hva::type() const
@@ -67,5 +393,24 @@ const size_t hva::section_count() const
 const vxlmatrix* hva::matrix(const size_t frame, const size_t section) const
 {
 	return (is_loaded() && frame < frame_count() && section < section_count()) ?
-		&_totalmatrices[frame * section_count() + section] : nullptr;
+		&_matrices[frame_index(frame) * section_count() + section] : nullptr;
+}
+
+std::string hva::section_name(const size_t section) const
+{
+	if (!_names || section >= section_count())
+		return {};
+
+	const char* name = _names + section * name_length;
+	return std::string(name, std::find(name, name + name_length, '\0'));
+}
+
+bool hva::find_section(const std::string& name, size_t& section) const
+{
+	const auto found = _name_index.find(name);
+	if (found == _name_index.end())
+		return false;
+
+	section = found->second;
+	return true;
 }
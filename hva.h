@@ -20,9 +20,40 @@ public:
 	const size_t section_count()const;
 	const vxlmatrix* matrix(const size_t frame, const size_t section) const;
 
+	//name as stored in the file, up to 16 characters
+	std::string section_name(const size_t section) const;
+	bool find_section(const std::string& name, size_t& section) const;
+
+	//frames holding the same matrices share an index in the compact form, every frame has its own otherwise
+	size_t unique_frame_count() const;
+	size_t frame_index(const size_t frame) const;
+
+	//the standard format, the loaded file is not held open and can be overwritten
+	bool save(const std::filesystem::path& path) const;
+	//companion form read by load as well, repeated frames are stored once
+	//rotation and scale become 16 bit fixed point, translations stay float
+	bool save_compact(const std::filesystem::path& path) const;
+
 private:
+	static constexpr const size_t name_length = 0x10u;
+
+	//points into data, sizes beyond size are rejected
+	bool read_view(const char* data, const size_t size);
+	//decodes the compact form into owned storage
+	bool read_compact(const char* data, const size_t size);
+	static bool is_compact(const char* data, const size_t size);
+	//built once per load, lookups from other threads only read it
+	void index_names();
+
 	char _signature[0x10u]{ 0 };
 	uint32_t _framecount{ 0 };
 	uint32_t _sectioncount{ 0 };
-	std::vector<vxlmatrix> _totalmatrices;
+	//the standard format is read in place from a copy of the file, copies of the hva share it
+	std::shared_ptr<const void> _storage;
+	const char* _names = nullptr;
+	const vxlmatrix* _matrices = nullptr;
+	//unique frame of every frame, none for the standard format
+	const uint32_t* _frame_map = nullptr;
+	size_t _unique_frames = 0;
+	std::unordered_map<std::string, size_t> _name_index;
 };
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "hva_animation.h"
+#include "log.h"
+
+bool hva_animation::build(const vxl& vxl, const hva& hva)
+{
+	_limbs.clear();
+	_limb_names.clear();
+	if (!vxl.is_loaded())
+		return false;
+
+	for (size_t i = 0; i < vxl.limb_count(); i++)
+	{
+		const vxl_limb_tailer* tailer = vxl.limb_tailer(i);
+		const DirectX::XMVECTOR minbound = { tailer->min_bounds[0],tailer->min_bounds[1],tailer->min_bounds[2],0.0f };
+		const DirectX::XMVECTOR maxbound = { tailer->max_bounds[0],tailer->max_bounds[1],tailer->max_bounds[2],0.0f };
+		const DirectX::XMVECTOR dimension = { static_cast<float>(tailer->xsize),static_cast<float>(tailer->ysize),static_cast<float>(tailer->zsize),1.0f };
+		const DirectX::XMVECTOR voxel_size = (maxbound - minbound) / dimension;
+
+		limb_bounds limb;
+		limb.prefix = DirectX::XMMatrixTranslationFromVector(minbound) * DirectX::XMMatrixScalingFromVector(voxel_size);
+		limb.translation_scale = voxel_size * tailer->scale;
+		_limbs.push_back(limb);
+
+		const char* name = vxl.limb_header(i)->name;
+		_limb_names.emplace_back(name, std::find(name, name + sizeof vxl_limb_header::name, '\0'));
+	}
+
+	return rebuild(hva);
+}
+
+bool hva_animation::rebuild(const hva& hva)
+{
+	_models.clear();
+	_translations.clear();
+	_frame_map.clear();
+	_source = nullptr;
+	_frames = 0;
+
+	if (_limbs.empty() || !hva.is_loaded() || !match_sections(hva))
+		return false;
+
+	//repeated frames of a compact hva are composed once
+	_frames = hva.frame_count();
+	_frame_map.resize(_frames);
+	_models.resize(hva.unique_frame_count() * _limbs.size());
+	_translations.resize(_models.size());
+	std::vector<bool> composed(hva.unique_frame_count(), false);
+	for (size_t f = 0; f < _frames; f++)
+	{
+		const size_t unique = hva.frame_index(f);
+		_frame_map[f] = static_cast<uint32_t>(unique);
+		if (composed[unique])
+			continue;
+
+		composed[unique] = true;
+		for (size_t s = 0; s < _limbs.size(); s++)
+		{
+			//hva matrices are column major 3x4
+			const vxlmatrix& matrix = *hva.matrix(f, _sections[s]);
+			const DirectX::XMVECTOR translation = { matrix._data[0][3],matrix._data[1][3],matrix._data[2][3],0.0f };
+			DirectX::XMMATRIX base = {
+				matrix._data[0][0],matrix._data[1][0],matrix._data[2][0],0.0f,
+				matrix._data[0][1],matrix._data[1][1],matrix._data[2][1],0.0f,
+				matrix._data[0][2],matrix._data[1][2],matrix._data[2][2],0.0f,
+				0.0f,0.0f,0.0f,1.0f,
+			};
+			base.r[3] = DirectX::XMVectorSetW(translation * _limbs[s].translation_scale, 1.0f);
+
+			_models[unique * _limbs.size() + s] = _limbs[s].prefix * base;
+			_translations[unique * _limbs.size() + s] = translation;
+		}
+	}
+
+	_source = &hva;
+	return true;
+}
+
+bool hva_animation::built_for(const hva& hva) const
+{
+	return _source == &hva && _frames == hva.frame_count();
+}
+
+bool hva_animation::is_built() const
+{
+	return !_models.empty();
+}
+
+bool hva_animation::match_sections(const hva& hva)
+{
+	_sections.assign(_limbs.size(), 0);
+
+	bool named = true;
+	for (size_t i = 0; i < _limbs.size() && named; i++)
+		named = hva.find_section(_limb_names[i], _sections[i]);
+	if (named)
+		return true;
+
+	if (hva.section_count() != _limbs.size())
+	{
+		LOG(ERROR) << "Hva sections do not match the vxl limbs by name or by count.\n";
+		return false;
+	}
+
+	for (size_t i = 0; i < _limbs.size(); i++)
+		_sections[i] = i;
+	return true;
+}
+
+size_t hva_animation::frame_count() const
+{
+	return _frames;
+}
+
+size_t hva_animation::section_count() const
+{
+	return _limbs.size();
+}
+
+const DirectX::XMMATRIX& hva_animation::model(const size_t frame, const size_t section) const
+{
+	return _models[_frame_map[frame % _frames] * _limbs.size() + section];
+}
+
+DirectX::XMMATRIX hva_animation::model(const size_t frame, const size_t section, const float prerotation, const float offset) const
+{
+	if (prerotation == 0.0f && offset == 0.0f)
+		return model(frame, section);
+
+	//the cached translation was scaled before the rotation, the difference is moved back in
+	const size_t idx = _frame_map[frame % _frames] * _limbs.size() + section;
+	const DirectX::XMMATRIX rotation = DirectX::XMMatrixRotationZ(prerotation);
+	const DirectX::XMVECTOR& translation = _translations[idx];
+	const DirectX::XMVECTOR& scale = _limbs[section].translation_scale;
+	const DirectX::XMVECTOR correction = DirectX::XMVector3TransformNormal(translation, rotation) * scale
+		- DirectX::XMVector3TransformNormal(translation * scale, rotation);
+
+	DirectX::XMMATRIX result = _models[idx] * rotation;
+	result.r[3] = result.r[3] + correction + DirectX::XMVectorSet(offset, 0.0f, 0.0f, 0.0f);
+	return result;
+}
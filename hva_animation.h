@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vxl.h"
+#include "hva.h"
+
+//model space transforms of every (frame, section) of a vxl and hva pair, built once per load
+//a transform already holds the bounds scaling and the tailer scale, drawing only multiplies it by the world
+//limbs find their hva section by name, by position when a name is missing and the counts agree
+class hva_animation
+{
+public:
+	hva_animation() = default;
+	~hva_animation() = default;
+
+	bool build(const vxl& vxl, const hva& hva);
+	//same limbs, matrices of another hva
+	bool rebuild(const hva& hva);
+	//built from this hva object with its current frame and section counts
+	bool built_for(const hva& hva) const;
+	bool is_built() const;
+
+	size_t frame_count() const;
+	size_t section_count() const;
+
+	//sections are limbs of the vxl here, frames wrap around
+	const DirectX::XMMATRIX& model(const size_t frame, const size_t section) const;
+	//turned around z before the translation is scaled and moved along x afterwards, as turrets and barrels are
+	DirectX::XMMATRIX model(const size_t frame, const size_t section, const float prerotation, const float offset) const;
+
+private:
+	//hva section of every limb
+	bool match_sections(const hva& hva);
+
+	struct limb_bounds
+	{
+		//translation to the min bounds times the voxel size
+		DirectX::XMMATRIX prefix{ DirectX::XMMatrixIdentity() };
+		//hva translations are scaled by this
+		DirectX::XMVECTOR translation_scale{ 0 };
+	};
+
+	std::vector<limb_bounds> _limbs;
+	std::vector<std::string> _limb_names;
+	std::vector<size_t> _sections;
+	//one block of limbs per unique frame of the hva
+	std::vector<DirectX::XMMATRIX> _models;
+	std::vector<uint32_t> _frame_map;
+	//hva translations before scaling, needed when a prerotation is applied
+	std::vector<DirectX::XMVECTOR> _translations;
+	const hva* _source = nullptr;
+	size_t _frames = 0;
+};
@@ -2,13 +2,104 @@
 #include "filedefinitions.h"
 
 #include <Ole2.h>
+#include <thread>
 
-std::ofstream logger::_logfile;
-logger logger::instance;
+namespace
+{
+	//a bounded multi producer queue, every slot carries the position it is ready for
+	constexpr const size_t ring_size = 4096;
+	static_assert((ring_size & (ring_size - 1)) == 0, "the ring size has to be a power of two");
+
+	struct slot
+	{
+		std::atomic<size_t> sequence;
+		size_t length;
+		char text[logger::line_capacity];
+	};
+
+	slot ring[ring_size];
+	std::atomic<size_t> write_pos = 0;
+	size_t read_pos = 0;
+	std::atomic<size_t> dropped = 0;
+
+	std::ofstream logfile;
+	std::thread writer;
+	std::atomic<bool> stopping = false;
+
+	//bumped for every published line and on stop, the writer sleeps on it while the ring is empty
+	//producers only notify when the writer said it is going to sleep
+	std::atomic<uint32_t> wakeups = 0;
+	std::atomic<bool> writer_sleeping = false;
+
+	void wake_writer()
+	{
+		wakeups.fetch_add(1, std::memory_order_seq_cst);
+		if (writer_sleeping.load(std::memory_order_seq_cst))
+			wakeups.notify_one();
+	}
+
+	//an exit that skips uninitialize still gets the ring written and the writer joined before they are destroyed
+	struct writer_guard
+	{
+		~writer_guard()
+		{
+			logger::uninitialize();
+		}
+	} guard;
+}
+
+std::atomic<bool> logger::_active = false;
+std::atomic<uint32_t> logger::_level = static_cast<uint32_t>(log_level::info);
+
+log_level log_level_from_string(const std::string& name)
+{
+	std::string lower = name;
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](const char c) { return static_cast<char>(tolower(c)); });
+
+	if (lower == "debug")
+		return log_level::debug;
+	if (lower == "warning")
+		return log_level::warning;
+	if (lower == "error")
+		return log_level::error;
+	if (lower == "none")
+		return log_level::none;
+	return log_level::info;
+}
+
+logger::line::fixed_buffer::fixed_buffer(char* begin, char* end)
+{
+	setp(begin, end);
+}
+
+size_t logger::line::fixed_buffer::size() const
+{
+	return static_cast<size_t>(pptr() - pbase());
+}
+
+logger::line::fixed_buffer::int_type logger::line::fixed_buffer::overflow(int_type ch)
+{
+	//the rest of a long line is dropped
+	return traits_type::not_eof(ch);
+}
+
+logger::line::line(const log_level level, const char* prefix) : _level(level), _buffer(_text, _text + line_capacity), _stream(&_buffer)
+{
+	_stream << prefix;
+}
+
+logger::line::~line()
+{
+	const size_t length = _buffer.size();
+	if (length == line_capacity)
+		_text[length - 1] = '\n';
+
+	push(_text, length, _level >= log_level::error);
+}
 
 bool logger::initialize()
 {
-	if (_logfile.is_open())
+	if (logfile.is_open())
 	{
 		return true;
 	}
@@ -30,14 +121,117 @@ bool logger::initialize()
 	time_string << std::put_time(std::localtime(&current_t), "%F-%H-%M-%S");
 	std::filesystem::path filename = log_path / ("debug-log " + time_string.str() + ".log");
 
-	_logfile.open(filename.string());
-	return _logfile.is_open();
+	logfile.open(filename.string());
+	if (!logfile.is_open())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < ring_size; i++)
+		ring[i].sequence.store(i, std::memory_order_relaxed);
+	write_pos.store(0, std::memory_order_relaxed);
+	read_pos = 0;
+	dropped.store(0, std::memory_order_relaxed);
+	stopping.store(false, std::memory_order_relaxed);
+
+	writer = std::thread(drain);
+	_active.store(true, std::memory_order_release);
+	return true;
 }
 
 void logger::uninitialize()
 {
-	if (_logfile)
+	if (!logfile.is_open())
+	{
+		return;
+	}
+
+	//the writer empties the ring before it stops
+	_active.store(false, std::memory_order_release);
+	stopping.store(true, std::memory_order_release);
+	wake_writer();
+	if (writer.joinable())
+		writer.join();
+
+	logfile.close();
+}
+
+void logger::set_level(const log_level level)
+{
+	_level.store(static_cast<uint32_t>(level), std::memory_order_relaxed);
+}
+
+void logger::push(const char* text, const size_t length, const bool wait)
+{
+	size_t pos = write_pos.load(std::memory_order_relaxed);
+	slot* target = nullptr;
+	while (!target)
+	{
+		slot& candidate = ring[pos & (ring_size - 1)];
+		const size_t sequence = candidate.sequence.load(std::memory_order_acquire);
+		if (sequence == pos)
+		{
+			if (write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				target = &candidate;
+		}
+		else if (sequence < pos && wait && !stopping.load(std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+			pos = write_pos.load(std::memory_order_relaxed);
+		}
+		else if (sequence < pos)
+		{
+			//a stopping writer frees no more slots, waiting could last forever
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		else
+			pos = write_pos.load(std::memory_order_relaxed);
+	}
+
+	memcpy(target->text, text, length);
+	target->length = length;
+	target->sequence.store(pos + 1, std::memory_order_release);
+	wake_writer();
+}
+
+void logger::drain()
+{
+	while (true)
 	{
-		_logfile.close();
+		//stopping is read before the ring so nothing pushed earlier is missed
+		const bool stop = stopping.load(std::memory_order_acquire);
+		size_t written = 0;
+		for (slot* current = &ring[read_pos & (ring_size - 1)];
+			current->sequence.load(std::memory_order_acquire) == read_pos + 1;
+			current = &ring[read_pos & (ring_size - 1)])
+		{
+			logfile.write(current->text, current->length);
+#ifdef _DEBUG
+			std::cout.write(current->text, current->length);
+#endif
+			current->sequence.store(read_pos + ring_size, std::memory_order_release);
+			read_pos++;
+			written++;
+		}
+
+		if (const size_t lost = dropped.exchange(0, std::memory_order_relaxed))
+			logfile << "WARNING : " << lost << " log lines were dropped, the ring was full.\n";
+
+		if (written)
+		{
+			logfile.flush();
+			continue;
+		}
+		if (stop)
+			break;
+
+		//a line published after the wakeups were read changes them and the wait returns at once
+		writer_sleeping.store(true, std::memory_order_seq_cst);
+		const uint32_t seen = wakeups.load(std::memory_order_seq_cst);
+		if (ring[read_pos & (ring_size - 1)].sequence.load(std::memory_order_acquire) != read_pos + 1 &&
+			!stopping.load(std::memory_order_acquire))
+			wakeups.wait(seen, std::memory_order_seq_cst);
+		writer_sleeping.store(false, std::memory_order_relaxed);
 	}
 }
@@ -2,42 +2,92 @@
 
 #include "general_headers.h"
 
+#include <atomic>
+
+enum class log_level : uint32_t
+{
+	debug = 0,
+	info = 1,
+	warning = 2,
+	error = 3,
+	none = 4,
+};
+
+//the names LOG takes, ERROR is a windows macro so the level name is pasted onto this prefix
+constexpr const log_level log_level_DEBUG = log_level::debug;
+constexpr const log_level log_level_INFO = log_level::info;
+constexpr const log_level log_level_WARNING = log_level::warning;
+constexpr const log_level log_level_ERROR = log_level::error;
+
+//levels below this are compiled out
+#ifndef LOG_MIN_LEVEL
+#ifdef _DEBUG
+#define LOG_MIN_LEVEL 0
+#else
+#define LOG_MIN_LEVEL 1
+#endif
+#endif
+
+//parses debug/info/warning/error/none, anything else is info
+log_level log_level_from_string(const std::string& name);
+
+//a line is formatted on the calling thread into a fixed buffer, then copied into a ring drained by a writer thread
+//producers never lock, a full ring drops lines below error and the writer reports how many were lost
+//errors wait for a free slot instead while the writer runs, the writer sleeps until a line is published
 class logger
 {
 public:
-	logger() = default;
-	~logger() = default;
+	static constexpr const size_t line_capacity = 512;
 
-	static logger instance;
-	static bool initialize();
-	static void uninitialize();
-
-	template<typename T>
-	static void writelog(const T& arg)
+	//one LOG statement, handed to the ring when it goes out of scope, longer lines are cut
+	class line
 	{
-		if (!_logfile)
+	public:
+		line(const log_level level, const char* prefix);
+		~line();
+
+		line(const line&) = delete;
+		line& operator=(const line&) = delete;
+
+		template<typename T>
+		line& operator<<(const T& arg)
 		{
-			return;
+			_stream << arg;
+			return *this;
 		}
 
-		_logfile << arg << std::endl;
-	}
+	private:
+		class fixed_buffer : public std::streambuf
+		{
+		public:
+			fixed_buffer(char* begin, char* end);
+			size_t size() const;
+
+		protected:
+			int_type overflow(int_type ch) override;
+		};
 
-	template<typename T>
-	logger& operator<<(const T& arg)
+		log_level _level;
+		char _text[line_capacity];
+		fixed_buffer _buffer;
+		std::ostream _stream;
+	};
+
+	static bool initialize();
+	static void uninitialize();
+
+	static void set_level(const log_level level);
+	static bool enabled(const log_level level)
 	{
-		if (_logfile)
-		{
-			_logfile << arg;
-#ifdef _DEBUG
-			std::cout << arg;
-#endif
-		}
-		return *this;
+		return _active.load(std::memory_order_relaxed) && static_cast<uint32_t>(level) >= _level.load(std::memory_order_relaxed);
 	}
 
 private:
-	static std::ofstream _logfile;
+	static void push(const char* text, const size_t length, const bool wait);
+	static void drain();
+
+	static std::atomic<bool> _active;
+	static std::atomic<uint32_t> _level;
 };
 
-#define LOG(LEVEL) logger::instance<<#LEVEL" : "
\ No newline at end of file
+#define LOG(LEVEL) if (static_cast<uint32_t>(log_level_##LEVEL) < LOG_MIN_LEVEL || !logger::enabled(log_level_##LEVEL)) ; else logger::line(log_level_##LEVEL, #LEVEL" : ")
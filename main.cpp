@@ -624,6 +624,7 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 			for (const auto& pairs : section)
 			{
 				const auto values = assets::ini.value_as_int(sec_name, pairs.first);
+				const std::string color_name(pairs.first);
 				if (values.size() >= 3)
 				{
 					temp.r = static_cast<byte>(std::clamp(values[0], 0, 255));
@@ -631,13 +632,13 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 					temp.b = static_cast<byte>(std::clamp(values[2], 0, 255));
 
 					bool new_string = false;
-					auto find = test_window::colors.find(pairs.first);
+					auto find = test_window::colors.find(color_name);
 					if (find == test_window::colors.end())
 						new_string = true;
 
-					test_window::colors[pairs.first] = temp;
+					test_window::colors[color_name] = temp;
 					if(new_string)
-						SendMessageA(color_sel, CB_ADDSTRING, NULL, reinterpret_cast<LPARAM>(pairs.first.c_str()));
+						SendMessageA(color_sel, CB_ADDSTRING, NULL, reinterpret_cast<LPARAM>(color_name.c_str()));
 				}
 			}
 
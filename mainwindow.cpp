@@ -4,6 +4,15 @@
 #include "vxl.h"
 #include "vpl.h"
 #include "config.h"
+#include "hash.h"
+#include "render_cache.h"
+#include "composite.h"
+#include "vpl_generator.h"
+#include "quantizer.h"
+#include "vpl_analysis.h"
+#include "frame_schedule.h"
+#include "shot_settings.h"
+#include "profiler.h"
 
 #include "stb_includer.h"
 #include "imgui.h"
@@ -27,105 +36,19 @@
 
 static const float pixels_to_leptons = 30.0f * sqrt(2.0f) / 256.0f;
 
-struct colorset_desc
-{
-	std::string name = "Default";
-	size_t start = 1, end = 255;
-	bool self_restricted = false;
-	std::vector<bool> color_selection = std::vector<bool>(256u, true);
-	float ambient = 0.6f, diffuse = 0.8f, specular = 1.2f;
-
-	colorset_desc() {
-		color_selection[0] = false;
-	}
-
-	void parse_ini(const std::string& keyname, const config::value_type& values)
-	{
-		name = keyname;
-		size_t remained_paras = values.size();
-
-		//start
-		if (remained_paras > 0u) {
-			start = atoi(values[0].c_str());
-			start = std::clamp(start, (size_t)1u, (size_t)255u);
-			remained_paras--;
-		}
-
-		//end
-		if (remained_paras > 0u) {
-			end = atoi(values[1].c_str());
-			end = std::clamp(end, (size_t)1u, (size_t)255u);
-			remained_paras--;
-		}
-
-		if (end <= start)
-			std::swap(end, start);
-
-		//self restricted
-		if (remained_paras > 0u) {
-			std::fill_n(color_selection.begin(), color_selection.size(), false);
-
-			char first = toupper(values[2][0]);
-			if (first == 'Y' || first == '1' || first == 'T')
-				std::fill_n(color_selection.begin() + start, end - start + 1u, true);
-			else
-				std::fill_n(color_selection.begin() + 1u, 255u, true);
-
-			remained_paras--;
-		}
-
-		//ambient
-		if (remained_paras > 0u) {
-			ambient = atof(values[3].c_str());
-			remained_paras--;
-		}
-
-		//diffuse
-		if (remained_paras > 0u) {
-			diffuse = atof(values[4].c_str());
-			remained_paras--;
-		}
-
-		//specular
-		if (remained_paras > 0u) {
-			specular = atof(values[5].c_str());
-			remained_paras--;
-		}
-
-		//color selection
-		size_t starting_idx = 6u, para_idx = 0u;
-		if (remained_paras > 0u) {
-			std::fill_n(color_selection.begin(), color_selection.size(), false);
-		}
-
-		while (remained_paras > 0u) {
-			const auto& value = values[starting_idx + para_idx];
-			if (value != "0")
-				color_selection[para_idx] = true;
-
-			remained_paras--;
-			para_idx++;
-		}
-		color_selection[0] = false;
-	}
-};
 namespace mainproc
 {
 	vpl_renderer renderer;
+	vpl_generator generator;
 	HWND mainwin = NULL;
 };
 
 namespace shot
 {
-	size_t directions = 8;
-	std::string output_dir = "output";
+	shot_settings settings;
 	std::string filename;
-	bool generate_ingame_like_previews = false;
-	bool generate_shadow = false;
-	bool generate_integrated_shadow = false;
-	std::string bgfilename = "background.png";
-	size_t celloffsetx = 6;
-	size_t celloffsety = 6;
+	//what the renders of the last shot did, the previews are not included
+	render_stats stats;
 }
 
 namespace assets
@@ -193,23 +116,20 @@ void screen_shot(const std::string& filename, const std::string& path)
 	if (!renderer.valid())
 		return;
 
-	size_t directions = shot::directions;
+	//the whole shot reads one copy, changes made while it runs wait for the next one
+	const shot_settings settings = shot::settings;
+	renderer.reset_batch_stats();
+
+	size_t directions = settings.directions;
 	float starting_angle = -1.25f * DirectX::g_XMPi.f[0];
 	float angle_step = DirectX::g_XMTwoPi.f[0] / directions;
 
-	const size_t body_frames = assets::hva.frame_count();
-	const size_t turret_frames = assets::tur_hva.frame_count();
-	const size_t barrel_frames = assets::barl_hva.frame_count();
-
-	size_t min_ab = 1, min_bc = 1;
-	for (size_t i = 1; i <= std::min(body_frames, turret_frames); i++)
-		if (!(body_frames % i) && !(turret_frames % i))
-			min_ab = i;
+	const hva* hvas[] = { &assets::hva,&assets::tur_hva,&assets::barl_hva };
 
-	size_t max_ab = std::max(body_frames, static_cast<size_t>(1u)) * std::max(turret_frames, static_cast<size_t>(1u)) / min_ab;
-	for (size_t i = 1; i <= std::min(barrel_frames, max_ab); i++)
-		if (!(barrel_frames % i) && !(max_ab % i))
-			min_bc = i;
+	//body, turret and barrel loop their own frame counts, a step repeating an earlier pose is not rendered again
+	frame_schedule schedule;
+	if (!schedule.plan(hvas, _countof(hvas), settings.deduplicate_frames))
+		return;
 
 	if (!std::filesystem::exists(path))
 		std::filesystem::create_directory(path);
@@ -218,103 +138,226 @@ void screen_shot(const std::string& filename, const std::string& path)
 	target /= filename;
 
 	const float reload_Z = static_cast<float>(ui_states::turret_rotation) * DirectX::g_XMTwoPi.f[0] / 100.0f;
-	const hva* hvas[] = { &assets::hva,&assets::tur_hva,&assets::barl_hva };
 	auto shadow_matrix = DirectX::XMMatrixScaling(1.0f, 1.0f, 0.0f);
-	size_t frame_per_direction = std::max(max_ab, static_cast<size_t>(1u)) * std::max(barrel_frames, static_cast<size_t>(1u)) / min_bc;
+	const DirectX::XMVECTOR shadow_bg = { 0.0f,0.0f,1.0f,0.0f };
+	const size_t frame_per_direction = schedule.cycle_length();
+
+	if (settings.write_schedule)
+	{
+		target.replace_filename(filename + " schedule");
+		target.replace_extension(".ini");
+		schedule.save(target);
+	}
+
+	//cropped frames keep their offsets on the canvas, like shp frame headers
+	//returns the index whose image holds the frame
+	frame_table table;
+	auto write_frame = [&](const cropped_frame& frame, const size_t file_idx) -> size_t {
+		PROFILE_SCOPE("screen_shot write_frame");
+		if (settings.deduplicate_frames)
+		{
+			const auto digest = frame.digest();
+			const size_t stored_index = table.find(digest);
+			if (stored_index != frame_table::npos)
+			{
+				table.add_reference(file_idx, stored_index);
+				return stored_index;
+			}
+
+			table.add(file_idx, frame, digest);
+		}
+		else
+			table.add(file_idx, frame);
+
+		target.replace_filename(filename + " " + std::to_string(file_idx));
+		target.replace_extension(".PNG");
+
+		if (settings.crop_frames)
+			frame.write_png(target);
+		else
+		{
+			const auto canvas = frame.expand();
+			stbi_write_png(target.string().c_str(), frame.canvas_width(), frame.canvas_height(), 4, canvas.data(), 0);
+		}
+
+		return file_idx;
+	};
+
+	//the single pass needs the box path, a software adapter falls back to separate passes
+	const bool single_pass = settings.generate_shadow && settings.single_pass_shadow && renderer.hardware_processing();
+
+	//everything but the pose and world is the same for the whole shot
+	render_cache cache;
+	hash128 shot_digest;
+	if (settings.use_render_cache && cache.open(get_exe_path() / settings.render_cache_dir))
+	{
+		hash_builder inputs;
+		for (const auto& file : { assets::vxl_path,assets::hva_path,assets::tur_path,assets::tur_hvapath,assets::barl_path,assets::barl_hvapath })
+			inputs.append(render_cache::file_digest(file));
+
+		inputs.append(assets::vpl.data(), assets::vpl.section_count() * sizeof(*assets::vpl.data()))
+			.append(assets::pal.entry(), sizeof(color[256]))
+			.append(renderer.get_light_dir())
+			.append(renderer.get_remap())
+			.append(renderer.get_extra_light())
+			.append(renderer.get_scale_factor())
+			.append(renderer.width())
+			.append(renderer.height())
+			//the compute and box paths light different entries
+			.append(renderer.hardware_processing())
+			//the single pass writes black shadow voxels, the separate pass coloured ones
+			.append(single_pass);
+		shot_digest = inputs.finish();
+	}
+
 	for (size_t current_dir = 0u, current_file_idx = 0u; current_dir < directions; current_dir++)
 	{
 		float current_angle = starting_angle + current_dir * angle_step;
 		DirectX::XMMATRIX world = DirectX::XMMatrixRotationZ(current_angle);
 		auto temp_world = renderer.get_world();
 
+		//same pose in one direction gives the same image, keep where the color and shadow frames of each step went
+		std::vector<std::pair<size_t, size_t>> stored_steps(frame_per_direction, { frame_table::npos,frame_table::npos });
+
 		for (size_t frame_idx = 0u; frame_idx < frame_per_direction; frame_idx++)
 		{
-			const size_t frames[] = { frame_idx,frame_idx,frame_idx };
+			const size_t* step_frames = schedule.frames(frame_idx);
+			const size_t frames[] = { step_frames[0],step_frames[1],step_frames[2] };
 			const float rotations[] = { current_angle,current_angle + reload_Z,current_angle + reload_Z };
 			const float offsets[] = { 0.0f, ui_states::turret_offset,ui_states::turret_offset };
+			const size_t shadow_file_idx = frame_per_direction * directions + current_file_idx;
+			size_t color_stored = frame_table::npos, shadow_stored = frame_table::npos;
+
+			if (!schedule.is_rendered(frame_idx))
+			{
+				std::tie(color_stored, shadow_stored) = stored_steps[schedule.source(frame_idx)];
+				if (color_stored != frame_table::npos)
+					table.add_reference(current_file_idx, color_stored);
+				if (shadow_stored != frame_table::npos)
+					table.add_reference(shadow_file_idx, shadow_stored);
+
+				current_file_idx++;
+				continue;
+			}
+
+			//hva matrices are only uploaded once a pass misses the cache
+			bool pose_loaded = false;
+			auto pass_key = [&](const DirectX::XMMATRIX& pass_world, const DirectX::XMVECTOR& pass_bg) {
+				return hash_builder()
+					.append(shot_digest)
+					.append(frames)
+					.append(rotations)
+					.append(offsets)
+					.append(pass_world)
+					.append(pass_bg)
+					.finish();
+			};
+
+			auto render_pass = [&]() {
+				hash128 key;
+				cropped_frame frame;
+				if (cache.valid())
+				{
+					key = pass_key(renderer.get_world(), renderer.get_bg_color());
+					if (cache.fetch(key, frame))
+						return frame;
+				}
+
+				if (!pose_loaded)
+					pose_loaded = renderer.reload_hva(hvas, frames, rotations, offsets, _countof(hvas));
+
+				renderer.clear_vxl_canvas();
+				renderer.render_loaded_vxl();
+				frame = renderer.render_target_frame();
+
+				if (cache.valid())
+					cache.store(key, frame);
+				return frame;
+			};
+
+			//both frames from one draw, cached under the same keys as the separate passes
+			auto render_with_shadow = [&](const DirectX::XMMATRIX& shadow_world, cropped_frame& color, cropped_frame& shadow) {
+				hash128 color_key, shadow_key;
+				if (cache.valid())
+				{
+					color_key = pass_key(renderer.get_world(), renderer.get_bg_color());
+					shadow_key = pass_key(shadow_world, shadow_bg);
+					if (cache.fetch(color_key, color) && cache.fetch(shadow_key, shadow))
+						return;
+				}
+
+				if (!pose_loaded)
+					pose_loaded = renderer.reload_hva(hvas, frames, rotations, offsets, _countof(hvas));
+
+				if (renderer.render_loaded_vxl_with_shadow(shadow_world, color, shadow) && cache.valid())
+				{
+					cache.store(color_key, color);
+					cache.store(shadow_key, shadow);
+				}
+			};
+
+			const auto shadow_world = shadow_matrix * temp_world;
+			cropped_frame front_frame, shadow_frame;
 
-			renderer.reload_hva(hvas, frames, rotations, offsets, _countof(hvas));
 			//renderer.set_world(world);
-			renderer.clear_vxl_canvas();
-			renderer.render_loaded_vxl();
-			auto front_buffer = renderer.render_target_data();
-			if (!shot::generate_integrated_shadow && !front_buffer.empty())
+			if (single_pass)
 			{
-				target.replace_filename(filename + " " + std::to_string(current_file_idx));
-				target.replace_extension(".PNG");
-				stbi_write_png(target.string().c_str(), renderer.width(), renderer.height(), 4, front_buffer.data(), 0);
+				//integrated shadows are blended under a transparent color frame later
+				const auto bg_color = renderer.get_bg_color();
+				if (settings.generate_integrated_shadow)
+					renderer.set_bg_color(shadow_bg);
+				render_with_shadow(shadow_world, front_frame, shadow_frame);
+				renderer.set_bg_color(bg_color);
 			}
+			else
+				front_frame = render_pass();
+
+			if (!settings.generate_integrated_shadow && front_frame.valid())
+				color_stored = write_frame(front_frame, current_file_idx);
 
-			if (shot::generate_shadow)
+			if (settings.generate_shadow)
 			{
 				auto bg_color = renderer.get_bg_color();
-				renderer.set_bg_color({ 0.0f,0.0f,1.0f,0.0f });
-				renderer.clear_vxl_canvas();
-				renderer.set_world(DirectX::XMMatrixScaling(1.0f, 1.0f, 0.0f) * temp_world);
-				renderer.render_loaded_vxl();
-				auto shadow_buffer = renderer.render_target_data();
-				if (!shadow_buffer.empty())
+				if (!single_pass)
+				{
+					renderer.set_bg_color(shadow_bg);
+					renderer.set_world(shadow_world);
+					shadow_frame = render_pass();
+				}
+
+				if (shadow_frame.valid())
 				{
+					PROFILE_SCOPE("screen_shot composite shadow");
+					auto shadow_buffer = shadow_frame.expand();
 					RGBQUAD bg = {};
 					bg.rgbRed = bg_color.vector4_f32[2] * 255.0f;
 					bg.rgbGreen = bg_color.vector4_f32[1] * 255.0f;
 					bg.rgbBlue = bg_color.vector4_f32[0] * 255.0f;
 					bg.rgbReserved = bg_color.vector4_f32[3] * 255.0f;
-					if (shot::generate_integrated_shadow)
+
+					//an opaque background fills the whole canvas, nothing to crop
+					const frame_rect full_canvas = { 0u,0u,static_cast<uint32_t>(renderer.width()),static_cast<uint32_t>(renderer.height()) };
+					if (settings.generate_integrated_shadow)
 					{
-						renderer.clear_vxl_canvas();
-						renderer.set_world(temp_world);
-						renderer.render_loaded_vxl();
-						front_buffer = renderer.render_target_data();
-						if (!front_buffer.empty())
+						if (!single_pass)
 						{
-							for (size_t y = 0; y < renderer.height(); y++)
-							{
-								for (size_t x = 0; x < renderer.width(); x++)
-								{
-									auto& shadowc = *reinterpret_cast<RGBQUAD*>(&shadow_buffer[4 * (y * renderer.width() + x)]);
-									auto& color = *reinterpret_cast<RGBQUAD*>(&front_buffer[4 * (y * renderer.width() + x)]);
-									if (shadowc.rgbReserved && !color.rgbReserved)
-									{
-										color.rgbRed = 0 * 127 / 255 + bg.rgbRed * (255 - 127) / 255;
-										color.rgbGreen = 0 * 127 / 255 + bg.rgbGreen * (255 - 127) / 255;
-										color.rgbBlue = 0 * 127 / 255 + bg.rgbBlue * (255 - 127) / 255;
-										color.rgbReserved = 127 + bg.rgbReserved * (255 - 127) / 255;
-									}
-									else if(!color.rgbReserved)
-									{
-										color = bg;
-									}
-								}
-							}
-							target.replace_filename(filename + " " + std::to_string(current_file_idx));
-							target.replace_extension(".PNG");
-							stbi_write_png(target.string().c_str(), renderer.width(), renderer.height(), 4, front_buffer.data(), 0);
+							renderer.set_world(temp_world);
+							front_frame = render_pass();
+						}
+
+						if (front_frame.valid())
+						{
+							auto front_buffer = front_frame.expand();
+							composite::background_fill(front_buffer.data(), shadow_buffer.data(), renderer.width() * renderer.height(), bg);
+							const auto bounds = bg.rgbReserved ? full_canvas : front_frame.bounds().united(shadow_frame.bounds());
+							color_stored = write_frame(cropped_frame::from_canvas(front_buffer, renderer.width(), renderer.height(), bounds), current_file_idx);
 						}
 					}
 					else
 					{
-						for (size_t y = 0; y < renderer.height(); y++)
-						{
-							for (size_t x = 0; x < renderer.width(); x++)
-							{
-								auto& shadowc = *reinterpret_cast<RGBQUAD*>(&shadow_buffer[4 * (y * renderer.width() + x)]);
-								if (shadowc.rgbReserved)
-								{
-									shadowc.rgbRed = 0 * 127 / 255 + bg.rgbRed * (255 - 127) / 255;
-									shadowc.rgbGreen = 0 * 127 / 255 + bg.rgbGreen * (255 - 127) / 255;
-									shadowc.rgbBlue = 0 * 127 / 255 + bg.rgbBlue * (255 - 127) / 255;
-									shadowc.rgbReserved = 127 + bg.rgbReserved * (255 - 127) / 255;
-								}
-								else
-								{
-									shadowc = bg;
-								}
-							}
-						}
-						target.replace_filename(filename + " " + std::to_string(frame_per_direction * directions + current_file_idx));
-						target.replace_extension(".PNG");
-						stbi_write_png(target.string().c_str(), renderer.width(), renderer.height(), 4, shadow_buffer.data(), 0);
+						composite::shadow_darken(shadow_buffer.data(), renderer.width() * renderer.height(), bg);
+						const auto bounds = bg.rgbReserved ? full_canvas : shadow_frame.bounds();
+						shadow_stored = write_frame(cropped_frame::from_canvas(shadow_buffer, renderer.width(), renderer.height(), bounds), shadow_file_idx);
 					}
 				}
 
@@ -322,18 +365,32 @@ void screen_shot(const std::string& filename, const std::string& path)
 				renderer.set_world(temp_world);
 			}
 
+			stored_steps[frame_idx] = { color_stored,shadow_stored };
+
 			current_file_idx++;
 		}
 	}
 
-	if (shot::generate_ingame_like_previews)
+	PROFILE_COUNT("stored frames", static_cast<int64_t>(table.stored_count()));
+	shot::stats = renderer.batch_stats();
+	LOG(INFO) << "Shot rendered " << shot::stats.voxels_submitted << " voxels in " << shot::stats.renders << " renders, "
+		<< shot::stats.pixels_written << " pixels written, " << (shot::stats.depth_rejects_exact ? "" : "at least ") << shot::stats.depth_rejected << " depth rejected, overdraw " << shot::stats.overdraw() << ".\n";
+	if (settings.crop_frames || settings.deduplicate_frames)
 	{
+		target.replace_filename(filename);
+		target.replace_extension(".ini");
+		table.save(target);
+	}
+
+	if (settings.generate_ingame_like_previews)
+	{
+		PROFILE_SCOPE("screen_shot ingame previews");
 		constexpr const size_t bgchannels = 4u;
 		constexpr const size_t cell_width = 60u;
 		constexpr const size_t cell_height = 30u;
 
-		const size_t bgwidth = renderer.width() + cell_width * shot::celloffsetx * 2u;
-		const size_t bgheight = renderer.height() + cell_height * shot::celloffsety * 2u;
+		const size_t bgwidth = renderer.width() + cell_width * settings.celloffsetx * 2u;
+		const size_t bgheight = renderer.height() + cell_height * settings.celloffsety * 2u;
 		std::unique_ptr<byte> output_buffer(new byte[bgwidth * bgheight * bgchannels]);
 		const size_t outputbuffer_pitch = bgwidth * bgchannels;
 
@@ -382,7 +439,7 @@ void screen_shot(const std::string& filename, const std::string& path)
 		//write render result to target
 		if (invalid == render_result_storage.end() && invalid_shadow == shadow_result_storage.end() && output_buffer && render_result_storage.size() == directions && shadow_result_storage.size() == directions)//valid
 		{
-			std::filesystem::path bgfile = get_exe_path() / shot::bgfilename;
+			std::filesystem::path bgfile = get_exe_path() / settings.bgfilename;
 			auto filebuffer = read_whole_file(bgfile.string());
 
 			//clear image
@@ -394,6 +451,18 @@ void screen_shot(const std::string& filename, const std::string& path)
 				auto filesize = std::filesystem::file_size(bgfile);
 				const auto bgimage_data = stbi_load_from_memory(reinterpret_cast<byte*>(filebuffer.get()), filesize, &output_width, &output_height, &output_channels, STBI_rgb_alpha);
 
+				if (bgimage_data && settings.quantize_background)
+				{
+					static palette_quantizer quantizer;
+					std::vector<byte> indices, quantized;
+					if (quantizer.set_palette(assets::pal) &&
+						quantizer.quantize(bgimage_data, output_width, output_height, output_width * 4u, indices, settings.background_dither) &&
+						quantizer.expand(indices, output_width, output_height, quantized))
+					{
+						memcpy(bgimage_data, quantized.data(), quantized.size());
+					}
+				}
+
 				//blit the image to the center
 				if (bgimage_data)
 				{
@@ -413,13 +482,10 @@ void screen_shot(const std::string& filename, const std::string& path)
 
 					for (size_t y = 0; y < blit_height; y++)
 					{
-						for (size_t x = 0; x < blit_width; x++)
-						{
-							size_t surface_cur = (surface_starty + y) * outputbuffer_pitch + (surface_startx + x) * bgchannels;
-							size_t image_buff_cur = (image_starty + y) * src_pitch + (image_startx + x) * 4u;
+						size_t surface_cur = (surface_starty + y) * outputbuffer_pitch + surface_startx * bgchannels;
+						size_t image_buff_cur = (image_starty + y) * src_pitch + image_startx * 4u;
 
-							*reinterpret_cast<RGBQUAD*>(&output_buffer.get()[surface_cur]) = *reinterpret_cast<RGBQUAD*>(&bgimage_data[image_buff_cur]);
-						}
+						memcpy(&output_buffer.get()[surface_cur], &bgimage_data[image_buff_cur], blit_width * 4u);
 					}
 				}
 
@@ -438,39 +504,20 @@ void screen_shot(const std::string& filename, const std::string& path)
 				const size_t block_y = block_idx / 3;
 				const size_t block_x = block_idx - block_y * 3;
 
-				const size_t start_x = block_x * shot::celloffsetx * cell_width;
-				const size_t start_y = block_y * shot::celloffsety * cell_height;
+				const size_t start_x = block_x * settings.celloffsetx * cell_width;
+				const size_t start_y = block_y * settings.celloffsety * cell_height;
 
 				auto& result = render_result_storage[dir];
 				auto& shadow = shadow_result_storage[dir];
 				const size_t src_pitch = renderer.width() * 4u;
 				for (size_t y = 0; y < renderer.height(); y++)
 				{
-					for (size_t x = 0; x < renderer.width(); x++)
-					{
-						size_t src_location = y * src_pitch + x * 4u;
-						size_t dst_location = (start_y + y) * outputbuffer_pitch + (start_x + x) * bgchannels;
-
-						if (shadow[src_location + 3u])
-						{
-							auto& color = *reinterpret_cast<RGBQUAD*>(&output_buffer.get()[dst_location]);
-							if (output_buffer.get()[dst_location + 3u])
-							{
-								color.rgbRed >>= 1u;
-								color.rgbGreen >>= 1u;
-								color.rgbBlue >>= 1u;
-							}
-							else
-							{
-								color = { 0u,0u,0u,127u };
-							}
-						}
+					size_t src_location = y * src_pitch;
+					size_t dst_location = (start_y + y) * outputbuffer_pitch + start_x * bgchannels;
 
-						if (result[src_location + 3u])
-						{
-							*reinterpret_cast<RGBQUAD*>(&output_buffer.get()[dst_location]) = *reinterpret_cast<RGBQUAD*>(&result[src_location]);
-						}
-					}
+					//shadow first, the unit is drawn over it
+					composite::half_darken(&output_buffer.get()[dst_location], &shadow[src_location], renderer.width());
+					composite::alpha_over(&output_buffer.get()[dst_location], &result[src_location], renderer.width());
 				}
 
 			}
@@ -482,6 +529,72 @@ void screen_shot(const std::string& filename, const std::string& path)
 	}
 }
 
+//the chrome trace and the timing table of everything recorded since the last clear
+void write_profile(const std::string& filename, const std::string& path, const std::string& notes = {})
+{
+	const std::filesystem::path target(path);
+	if (!std::filesystem::exists(target))
+		return;
+
+	profiler::write_trace(target / (filename + " trace.json"));
+	std::ofstream table(target / (filename + " timings.txt"));
+	table << profiler::summary_table() << "\n" << notes;
+	LOG(INFO) << "Timings were written to " << (target / (filename + " timings.txt")).string() << ".\n";
+}
+
+//a profiled shot starts with empty buffers and leaves a chrome trace and a timing table next to its images
+void profiled_screen_shot(const std::string& filename, const std::string& path)
+{
+	if (!shot::settings.profile)
+		return screen_shot(filename, path);
+
+	profiler::clear();
+	profiler::enable(true);
+	{
+		PROFILE_SCOPE("screen_shot");
+		screen_shot(filename, path);
+	}
+	profiler::enable(false);
+
+	write_profile(filename, path, shot::stats.summary());
+}
+
+//with [Settings] Profile set, loading the models leaves "<name> load trace.json" and "<name> load timings.txt" next to the shots
+void begin_load_profile()
+{
+	if (!shot::settings.profile)
+		return;
+
+	profiler::clear();
+	profiler::enable(true);
+}
+
+void end_load_profile()
+{
+	if (!shot::settings.profile)
+		return;
+
+	profiler::enable(false);
+	write_profile(shot::filename + " load", shot::settings.output_dir);
+}
+
+void load_model_files()
+{
+	assets::vxl.load(assets::vxl_path.string());
+	assets::hva.load(assets::hva_path.string());
+	assets::tur_vxl.load(assets::tur_path.string());
+	assets::tur_hva.load(assets::tur_hvapath.string());
+	assets::barl_vxl.load(assets::barl_path.string());
+	assets::barl_hva.load(assets::barl_hvapath.string());
+}
+
+void upload_models()
+{
+	mainproc::renderer.load_vxl(assets::vxl, assets::hva, 0, true);
+	mainproc::renderer.load_vxl(assets::tur_vxl, assets::tur_hva, 0);
+	mainproc::renderer.load_vxl(assets::barl_vxl, assets::barl_hva, 0);
+}
+
 std::filesystem::path select_folder()
 {
 	std::filesystem::path result;
@@ -529,63 +642,19 @@ double ColourDistance(RGB e1, RGB e2)
 */
 void update_vpl()
 {
-	auto& vpl = assets::vpl;
-	auto& pal = assets::pal;
-	const auto& colorset = ui_states::color_sets[ui_states::color_set_idx];
-
-	auto vpl_curve = [&colorset](const size_t section_idx)->double {
-		double f = section_idx / 16.0;
-
-		double spec = colorset.specular;
-		double ambient = colorset.ambient;
-		double diffuse = colorset.diffuse;
-
-		return f < 1.0 ? (ambient + f * diffuse) : (ambient + diffuse + (f - 1.0) * (diffuse + spec));
-	};
-
-	auto color_sqdistance = [](const color& color1, const color& color2) {
-		int dr = (int)color1.r - (int)color2.r;
-		int dg = (int)color1.g - (int)color2.g;
-		int db = (int)color1.b - (int)color2.b;
-		
-		int rmean = ((int)color1.r + (int)color2.r) / 2;
-		return (((512 + rmean) * dr * dr) >> 8) + 4 * dg * dg + (((767 - rmean) * db * db) >> 8);
-	};
-
-	for (size_t section_i = 0u; section_i < 32u; section_i++)
-	{
-		for (size_t i = colorset.start; i < colorset.end; i++)
-		{
-			double effector = vpl_curve(section_i);
-			const auto& orig_color = pal.entry()[i];
-			color target_color =
-			{
-				static_cast<byte>(std::clamp(orig_color.r * effector,0.0,255.0)),
-				static_cast<byte>(std::clamp(orig_color.g * effector,0.0,255.0)),
-				static_cast<byte>(std::clamp(orig_color.b * effector,0.0,255.0)),
-			};
-
-			double nearest_dis = 3.0 * 255.0 * 255.0;
-			size_t nearest_i = 1u;
-
-			size_t findstart = /*colorset.self_restricted ? colorset.start : */1u;
-			size_t findend = /*colorset.self_restricted ? colorset.end : */255u;
-			for (size_t f = findstart; f <= findend; f++)
-			{
-				if (!colorset.color_selection[f])
-					continue;
+	mainproc::generator.generate(assets::vpl, assets::pal, ui_states::color_sets[ui_states::color_set_idx]);
+}
 
-				double dis = color_sqdistance(pal.entry()[f], target_color);
-				if (dis < nearest_dis)
-				{
-					nearest_dis = dis;
-					nearest_i = f;
-				}
-			}
+//every set from settings.ini, the default set only when there is no other
+std::vector<colorset_desc> generated_sets()
+{
+	const auto& sets = ui_states::color_sets;
+	return sets.size() > 1u ? std::vector<colorset_desc>(sets.begin() + 1u, sets.end()) : sets;
+}
 
-			vpl.data()[section_i][i] = nearest_i;
-		}
-	}
+void update_all_vpl()
+{
+	mainproc::generator.generate_cached(assets::vpl, assets::pal, generated_sets());
 }
 
 std::filesystem::path value_cache_path()
@@ -608,6 +677,8 @@ void save_vpl_setting_cache()
 		{
 			values += L',' + std::to_wstring(sel);
 		}
+		const std::string metric = to_string(set.metric);
+		values += L',' + std::wstring(metric.begin(), metric.end());
 
 		WritePrivateProfileStringW(mainsec_file.c_str(), printbuffer, values.c_str(), path.c_str());
 	}
@@ -630,11 +701,17 @@ void load_vpl_setting_cache()
 		return l.name == r.name && l.start == r.start && l.end == r.end;//&& l.self_restricted == r.self_restricted;
 	};
 
+	//the metric follows the 6 values and the 256 selections, older caches end with the selections
+	constexpr const size_t metric_value = 6u + 256u;
 	for (const auto& pairs : section)
 	{
 		colorset_desc cache_desc = {};
 
-		cache_desc.parse_ini(pairs.first, pairs.second);
+		const auto& values = pairs.second;
+		cache_desc.parse_ini(pairs.first, values.first(std::min(values.size(), metric_value)));
+		const bool cached_metric = values.size() > metric_value;
+		if (cached_metric)
+			cache_desc.metric = color_metric_from_string(std::string(values[metric_value]));
 		for (size_t i = 1u; i < ui_states::color_sets.size(); i++) 
 		{
 			auto& set = ui_states::color_sets[i];
@@ -644,14 +721,14 @@ void load_vpl_setting_cache()
 				set.diffuse = cache_desc.diffuse;
 				set.specular = cache_desc.specular;
 				set.color_selection = cache_desc.color_selection;
+				if (cached_metric)
+					set.metric = cache_desc.metric;
 			}
-
-			ui_states::color_set_idx = i;
-			update_vpl();
 		}
-
-		ui_states::color_set_idx = 0;
 	}
+
+	ui_states::color_set_idx = 0;
+	update_all_vpl();
 }
 
 bool load_settings()
@@ -661,42 +738,40 @@ bool load_settings()
 	if (!config.is_loaded())
 		return false;
 
-	const auto settings = "Settings";
 	const auto colorsets = "ColorSets";
 
-	shot::output_dir = config.read_string(settings, "ScreenshotOutputDir", shot::output_dir);
-	shot::directions = config.read_int(settings, "DirectionCount", shot::directions);
-	shot::bgfilename = config.read_string(settings, "BackgroundFileName", shot::bgfilename);
-	shot::celloffsetx = static_cast<size_t>(std::abs(config.read_int(settings, "CellOffsetX", shot::celloffsetx)));
-	shot::celloffsety = static_cast<size_t>(std::abs(config.read_int(settings, "CellOffsetY", shot::celloffsety)));
-
-	DirectX::XMVECTOR setting_color = { 0.0f,0.0f,1.0f,1.0f };
-	auto bgcolor = assets::ini.value_as_int(settings, "BackgroundColor");
-	if (bgcolor.size() >= 4)
+	shot::settings.load(config);
+	logger::set_level(shot::settings.logging);
+	if (const auto& bgcolor = shot::settings.background_color)
 	{
+		DirectX::XMVECTOR setting_color = {};
 		for (size_t i = 0; i < 4; i++)
-			setting_color.vector4_f32[i] = static_cast<float>(std::clamp(bgcolor[i], 0, 255)) / 255.0f;
+			setting_color.vector4_f32[i] = static_cast<float>((*bgcolor)[i]) / 255.0f;
 		mainproc::renderer.set_bg_color(setting_color);
 	}
 
-	shot::generate_ingame_like_previews = assets::ini.read_bool(settings, "GenerateIngameViews", shot::generate_ingame_like_previews);
-	shot::generate_shadow = assets::ini.read_bool(settings, "GenerateShadow", shot::generate_shadow);
-	shot::generate_integrated_shadow = assets::ini.read_bool(settings, "IntegratedShadow", shot::generate_integrated_shadow);
+	mainproc::generator.set_thread_count(shot::settings.vpl_threads);
+	if (shot::settings.vpl_cache)
+		mainproc::generator.open_cache(get_exe_path() / shot::settings.vpl_cache_dir);
 
-	const auto def_light_data = assets::ini.value_as_double(settings, "DefaultLightDir");
-	if (def_light_data.size() >= 3u) 
+	if (const auto& def_light_data = shot::settings.light_direction)
 	{
-		ui_states::light_direction_config = { (float)def_light_data[0],(float)def_light_data[1],(float)def_light_data[2] };
+		ui_states::light_direction_config = { (*def_light_data)[0],(*def_light_data)[1],(*def_light_data)[2] };
 		ui_states::light_direction = ui_states::light_direction_config;
 	}
 
-	//colorsets
+	//colorsets, the matching metric is set per set name in ColorSetMetrics
+	const auto default_metric = shot::settings.default_metric;
+	ui_states::color_sets[0].metric = default_metric;
+
 	const auto& colorset_sec = config.section(colorsets);
 	for (const auto& keypairs : colorset_sec)
 	{
 		colorset_desc desc = {};
 
 		desc.parse_ini(keypairs.first, keypairs.second);
+		const auto metric_name = config.read_string("ColorSetMetrics", keypairs.first, "");
+		desc.metric = metric_name.empty() ? default_metric : color_metric_from_string(metric_name);
 
 		ui_states::color_sets.push_back(desc);
 	}
@@ -907,6 +982,18 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 #endif
 	UNREFERENCED_PARAMETER(CoInitialize(nullptr));
 	logger::initialize();
+#ifdef _DEBUG
+	composite::self_check();
+	nearest_color::self_check();
+#endif
+
+	//--benchmark logs the timings of the cpu kernels and exits
+	if (std::string_view(cmdline).starts_with("--benchmark"))
+	{
+		nearest_color::benchmark();
+		logger::uninitialize();
+		return 0;
+	}
 
 	std::filesystem::path current_dir = get_exe_path();
 	assets::vpl.load((current_dir / "voxels.vpl").string());
@@ -937,29 +1024,26 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 	std::filesystem::path filepath(cmd_temp);
 	std::string base_filename = filepath.filename().replace_extension().string();
 	shot::filename = base_filename;
-	assets::vxl.load(filepath.string());
 	assets::vxl_path = filepath;
 	filepath.replace_extension("hva");
-	assets::hva.load(filepath.string());
 	assets::hva_path = filepath;
 
 	filepath.replace_filename(base_filename + "tur");
 	filepath.replace_extension("vxl");
-	assets::tur_vxl.load(filepath.string());
 	assets::tur_path = filepath;
 	filepath.replace_extension("hva");
-	assets::tur_hva.load(filepath.string());
 	assets::tur_hvapath = filepath;
 
 	filepath.replace_filename(base_filename + "barl");
 	filepath.replace_extension("vxl");
-	assets::barl_vxl.load(filepath.string());
 	assets::barl_path = filepath;
 	filepath.replace_extension("hva");
-	assets::barl_hva.load(filepath.string());
 	assets::barl_hvapath = filepath;
 
+	//settings first so a profiled run times the loading too
 	load_settings();
+	begin_load_profile();
+	load_model_files();
 
 	const TCHAR* classname = TEXT("CXC_115");
 
@@ -991,10 +1075,10 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 			MoveWindow(mainwin, 100, 100, 1000, 600, TRUE);
 
 			mainproc::renderer.load_pal(assets::pal);
-			mainproc::renderer.load_vpl(assets::vpl);
-			mainproc::renderer.load_vxl(assets::vxl, assets::hva, 0, true);
-			mainproc::renderer.load_vxl(assets::tur_vxl, assets::tur_hva, 0);
-			mainproc::renderer.load_vxl(assets::barl_vxl, assets::barl_hva, 0);
+			if (mainproc::renderer.load_vpl(assets::vpl))
+				assets::vpl.clear_dirty();
+			upload_models();
+			end_load_profile();
 
 			auto last_tick = std::chrono::high_resolution_clock::now();
 			bool shutdown = false;
@@ -1034,16 +1118,10 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 
 					if (ImGui::Button("Reload"))
 					{
-						assets::vxl.load(assets::vxl_path.string());
-						assets::hva.load(assets::hva_path.string());
-						assets::tur_vxl.load(assets::tur_path.string());
-						assets::tur_hva.load(assets::tur_hvapath.string());
-						assets::barl_vxl.load(assets::barl_path.string());
-						assets::barl_hva.load(assets::barl_hvapath.string());
-
-						mainproc::renderer.load_vxl(assets::vxl, assets::hva, 0, true);
-						mainproc::renderer.load_vxl(assets::tur_vxl, assets::tur_hva, 0);
-						mainproc::renderer.load_vxl(assets::barl_vxl, assets::barl_hva, 0);
+						begin_load_profile();
+						load_model_files();
+						upload_models();
+						end_load_profile();
 					}
 
 					ImGui::SameLine();
@@ -1063,7 +1141,7 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 						GetWindowRect(mainwin, &temprect);
 						AdjustWindowRect(&targetrect, WS_OVERLAPPEDWINDOW, false);
 						MoveWindow(mainwin, 0, 0, targetrect.right - targetrect.left, targetrect.bottom - targetrect.top, false);
-						screen_shot(shot::filename, shot::output_dir);
+						profiled_screen_shot(shot::filename, shot::settings.output_dir);
 						MoveWindow(mainwin, temprect.left, temprect.top, temprect.right - temprect.left, temprect.bottom - temprect.top, true);
 					}
 
@@ -1119,10 +1197,24 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 					ImGui::SliderFloat("Diffuse", &colorset.diffuse, 0.0f, 5.0f);
 					ImGui::SliderFloat("Specular", &colorset.specular, 0.0f, 5.0f);
 
+					const char* metric_names[] = { "Redmean","OKLab","CIELAB" };
+					int metric_idx = static_cast<int>(colorset.metric);
+					if (ImGui::Combo("Color Metric", &metric_idx, metric_names, IM_ARRAYSIZE(metric_names)))
+						colorset.metric = static_cast<color_metric>(metric_idx);
+
 					if (ImGui::Button("Update VPL"))
 					{
 						update_vpl();
-						mainproc::renderer.load_vpl(assets::vpl);
+						if (mainproc::renderer.update_vpl(assets::vpl))
+							assets::vpl.clear_dirty();
+					}
+
+					ImGui::SameLine();
+					if (ImGui::Button("Update All Sets"))
+					{
+						update_all_vpl();
+						if (mainproc::renderer.update_vpl(assets::vpl))
+							assets::vpl.clear_dirty();
 					}
 
 					ImGui::SameLine();
@@ -1131,6 +1223,21 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 						assets::vpl.save(select_folder());
 					}
 
+					//findings go to the log
+					if (ImGui::Button("Analyze VPL"))
+					{
+						const auto result = vpl_analysis::analyze(assets::vpl, assets::pal, generated_sets());
+						vpl_analysis::log_report("Current VPL", result);
+						if (result.clean())
+							LOG(INFO) << "Current VPL: no findings.\n";
+					}
+
+					ImGui::SameLine();
+					if (ImGui::Button("Validate Folder"))
+					{
+						vpl_analysis::validate_directory(select_folder());
+					}
+
 					ImGui::SameLine();
 					ImGui::Checkbox("Show Color Selection Panel", &ui_states::show_colorsel_panel);
 
@@ -1195,5 +1302,6 @@ int __stdcall WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmdline
 	CoUninitialize();
 
 	save_vpl_setting_cache();
+	logger::uninitialize();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "mapped_file.h"
+#include "log.h"
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+bool mapped_file::open(const std::filesystem::path& path)
+{
+	close();
+
+	_file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_file == INVALID_HANDLE_VALUE)
+	{
+		LOG(ERROR) << "Failed to open " << path.string() << " for mapping.\n";
+		return false;
+	}
+
+	LARGE_INTEGER filesize = {};
+	if (!GetFileSizeEx(_file, &filesize) || !filesize.QuadPart)
+	{
+		LOG(ERROR) << "File " << path.string() << " is empty.\n";
+		close();
+		return false;
+	}
+
+	_mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	_view = _mapping ? reinterpret_cast<const byte*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	if (!_view)
+	{
+		LOG(ERROR) << "Failed to map " << path.string() << ".\n";
+		close();
+		return false;
+	}
+
+	_size = static_cast<size_t>(filesize.QuadPart);
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (_view)
+		UnmapViewOfFile(_view);
+	if (_mapping)
+		CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE)
+		CloseHandle(_file);
+
+	_file = INVALID_HANDLE_VALUE;
+	_mapping = nullptr;
+	_view = nullptr;
+	_size = 0;
+}
+
+bool mapped_file::is_open() const
+{
+	return _view != nullptr;
+}
+
+const byte* mapped_file::data() const
+{
+	return _view;
+}
+
+size_t mapped_file::size() const
+{
+	return _size;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "general_headers.h"
+
+//read only view of a whole file, the pages are loaded by the system when they are first touched
+class mapped_file
+{
+public:
+	mapped_file() = default;
+	~mapped_file();
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	bool open(const std::filesystem::path& path);
+	void close();
+	bool is_open() const;
+
+	const byte* data() const;
+	size_t size() const;
+
+private:
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = nullptr;
+	const byte* _view = nullptr;
+	size_t _size = 0;
+};
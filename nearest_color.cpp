@@ -0,0 +1,557 @@
+#include "nearest_color.h"
+#include "log.h"
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(__AVX2__)
+#define NEAREST_COLOR_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace
+{
+	//distance from a channel value to the closest and the farthest value of [low, high]
+	inline int near_delta(const int value, const int low, const int high)
+	{
+		return value < low ? low - value : (value > high ? value - high : 0);
+	}
+
+	inline int far_delta(const int value, const int low, const int high)
+	{
+		return std::max(std::abs(value - low), std::abs(value - high));
+	}
+
+	//srgb byte to linear light
+	const std::array<float, 256>& linear_table()
+	{
+		static const std::array<float, 256> table = []() {
+			std::array<float, 256> result = {};
+			for (size_t i = 0; i < result.size(); i++)
+			{
+				const double c = i / 255.0;
+				result[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+			}
+			return result;
+		}();
+		return table;
+	}
+
+	inline float lab_sqdistance(const nearest_color::lab_color& l, const nearest_color::lab_color& r)
+	{
+		const float d0 = l[0] - r[0], d1 = l[1] - r[1], d2 = l[2] - r[2];
+		return d0 * d0 + d1 * d1 + d2 * d2;
+	}
+}
+
+color_metric color_metric_from_string(const std::string& name)
+{
+	std::string lower = name;
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](const char c) { return static_cast<char>(tolower(c)); });
+
+	if (lower == "oklab")
+		return color_metric::oklab;
+	if (lower == "cielab" || lower == "lab")
+		return color_metric::cielab;
+	return color_metric::redmean;
+}
+
+const char* to_string(const color_metric metric)
+{
+	switch (metric)
+	{
+	case color_metric::oklab:
+		return "oklab";
+	case color_metric::cielab:
+		return "cielab";
+	default:
+		return "redmean";
+	}
+}
+
+void nearest_color::build(const palette& pal, const std::vector<bool>& selection, const color_metric metric)
+{
+	_metric = metric;
+	std::copy_n(pal.entry(), _entries.size(), _entries.begin());
+	_selection = selection;
+	_selection.resize(256u, false);
+
+	std::vector<byte> selected;
+	for (size_t i = 1u; i <= 255u; i++)
+	{
+		if (_selection[i])
+			selected.push_back(static_cast<byte>(i));
+	}
+
+	_selected_count = selected.size();
+	const size_t padded_count = (_selected_count + 7u) & ~size_t(7u);
+	_soa_r.assign(padded_count, 0);
+	_soa_g.assign(padded_count, 0);
+	_soa_b.assign(padded_count, 0);
+	_soa_index.assign(padded_count, 1u);
+	for (size_t s = 0; s < _selected_count; s++)
+	{
+		const auto& entry = _entries[selected[s]];
+		_soa_r[s] = entry.r;
+		_soa_g[s] = entry.g;
+		_soa_b[s] = entry.b;
+		_soa_index[s] = selected[s];
+	}
+
+	_tree.clear();
+	_tree_root = -1;
+	_cells.clear();
+	_candidates.clear();
+	if (_metric != color_metric::redmean)
+	{
+		for (const auto entry : selected)
+			_lab[entry] = to_lab(_entries[entry]);
+
+		_tree.reserve(selected.size());
+		_tree_root = build_tree(selected.data(), selected.size());
+		_built = true;
+		return;
+	}
+
+	_cells.assign(cells_per_axis * cells_per_axis * cells_per_axis, cell_range());
+	_candidates.clear();
+
+	constexpr const int cell_size = 1 << cell_bits;
+	std::vector<int> lower_bounds(selected.size());
+	for (size_t cr = 0; cr < cells_per_axis; cr++)
+	{
+		for (size_t cg = 0; cg < cells_per_axis; cg++)
+		{
+			for (size_t cb = 0; cb < cells_per_axis; cb++)
+			{
+				const int rlow = static_cast<int>(cr) * cell_size, rhigh = rlow + cell_size - 1;
+				const int glow = static_cast<int>(cg) * cell_size, ghigh = glow + cell_size - 1;
+				const int blow = static_cast<int>(cb) * cell_size, bhigh = blow + cell_size - 1;
+
+				//every term of the distance grows with its delta and its red mean weight, bound them separately
+				int best_upper = std::numeric_limits<int>::max();
+				for (size_t s = 0; s < selected.size(); s++)
+				{
+					const auto& entry = _entries[selected[s]];
+					const int rmean_low = (entry.r + rlow) / 2, rmean_high = (entry.r + rhigh) / 2;
+
+					int dr = near_delta(entry.r, rlow, rhigh), dg = near_delta(entry.g, glow, ghigh), db = near_delta(entry.b, blow, bhigh);
+					lower_bounds[s] = (((512 + rmean_low) * dr * dr) >> 8) + 4 * dg * dg + (((767 - rmean_high) * db * db) >> 8);
+
+					dr = far_delta(entry.r, rlow, rhigh), dg = far_delta(entry.g, glow, ghigh), db = far_delta(entry.b, blow, bhigh);
+					best_upper = std::min(best_upper, (((512 + rmean_high) * dr * dr) >> 8) + 4 * dg * dg + (((767 - rmean_low) * db * db) >> 8));
+				}
+
+				//ties are kept, the query resolves them by index
+				auto& cell = _cells[(cr << (2u * (8u - cell_bits))) | (cg << (8u - cell_bits)) | cb];
+				cell.offset = static_cast<uint32_t>(_candidates.size());
+				for (size_t s = 0; s < selected.size(); s++)
+				{
+					if (lower_bounds[s] <= best_upper)
+						_candidates.push_back(selected[s]);
+				}
+				cell.count = static_cast<uint32_t>(_candidates.size()) - cell.offset;
+			}
+		}
+	}
+
+	_built = true;
+}
+
+bool nearest_color::built_for(const palette& pal, const std::vector<bool>& selection, const color_metric metric) const
+{
+	if (!_built || _metric != metric)
+		return false;
+
+	for (size_t i = 0; i < _entries.size(); i++)
+	{
+		const auto& entry = pal.entry()[i];
+		if (entry.r != _entries[i].r || entry.g != _entries[i].g || entry.b != _entries[i].b)
+			return false;
+	}
+
+	for (size_t i = 0; i < _selection.size(); i++)
+	{
+		if (_selection[i] != (i < selection.size() && selection[i]))
+			return false;
+	}
+
+	return true;
+}
+
+bool nearest_color::is_built() const
+{
+	return _built;
+}
+
+color_metric nearest_color::metric() const
+{
+	return _metric;
+}
+
+byte nearest_color::find(const color& target) const
+{
+	if (!_built)
+		return 1u;
+
+	if (_metric != color_metric::redmean)
+		return find_perceptual(target);
+
+	const auto& cell = _cells[cell_index(target)];
+	//in crowded cells measuring the whole selection 8 at a time is cheaper
+	static const bool wide_scan = avx2_supported();
+	if (wide_scan && cell.count >= 16u && cell.count * 8u >= _selected_count)
+		return scan_avx2(target);
+
+	int nearest_dis = unmatched_distance;
+	byte nearest_i = 1u;
+
+	//candidates are in ascending order, the first of equally near entries wins
+	for (uint32_t i = cell.offset; i < cell.offset + cell.count; i++)
+	{
+		const byte f = _candidates[i];
+		const int dis = distance(_entries[f], target);
+		if (dis < nearest_dis)
+		{
+			nearest_dis = dis;
+			nearest_i = f;
+		}
+	}
+
+	return nearest_i;
+}
+
+byte nearest_color::scan(const color& target) const
+{
+	if (_metric != color_metric::redmean)
+		return find_perceptual(target);
+
+	static const bool wide_scan = avx2_supported();
+	return wide_scan ? scan_avx2(target) : scan_scalar(target);
+}
+
+byte nearest_color::scan_scalar(const color& target) const
+{
+	int nearest_dis = unmatched_distance;
+	byte nearest_i = 1u;
+
+	for (size_t s = 0; s < _selected_count; s++)
+	{
+		const int dis = distance(_entries[_soa_index[s]], target);
+		if (dis < nearest_dis)
+		{
+			nearest_dis = dis;
+			nearest_i = _soa_index[s];
+		}
+	}
+
+	return nearest_i;
+}
+
+byte nearest_color::scan_avx2(const color& target) const
+{
+#ifdef NEAREST_COLOR_AVX2
+	const __m256i tr = _mm256_set1_epi32(target.r);
+	const __m256i tg = _mm256_set1_epi32(target.g);
+	const __m256i tb = _mm256_set1_epi32(target.b);
+	const __m256i r_weight = _mm256_set1_epi32(512);
+	const __m256i b_weight = _mm256_set1_epi32(767);
+	const __m256i count = _mm256_set1_epi32(static_cast<int>(_selected_count));
+	const __m256i step = _mm256_set1_epi32(8);
+
+	//every lane keeps its own nearest, earlier positions win inside a lane
+	__m256i best_dis = _mm256_set1_epi32(unmatched_distance);
+	__m256i best_pos = _mm256_set1_epi32(-1);
+	__m256i pos = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for (size_t s = 0; s < _selected_count; s += 8u)
+	{
+		const __m256i er = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&_soa_r[s]));
+		const __m256i eg = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&_soa_g[s]));
+		const __m256i eb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&_soa_b[s]));
+
+		const __m256i dr = _mm256_sub_epi32(er, tr);
+		const __m256i dg = _mm256_sub_epi32(eg, tg);
+		const __m256i db = _mm256_sub_epi32(eb, tb);
+		const __m256i rmean = _mm256_srli_epi32(_mm256_add_epi32(er, tr), 1);
+
+		const __m256i rterm = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_add_epi32(r_weight, rmean), _mm256_mullo_epi32(dr, dr)), 8);
+		const __m256i gterm = _mm256_slli_epi32(_mm256_mullo_epi32(dg, dg), 2);
+		const __m256i bterm = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(b_weight, rmean), _mm256_mullo_epi32(db, db)), 8);
+		const __m256i dis = _mm256_add_epi32(_mm256_add_epi32(rterm, gterm), bterm);
+
+		//padding lanes never improve
+		const __m256i better = _mm256_and_si256(_mm256_cmpgt_epi32(best_dis, dis), _mm256_cmpgt_epi32(count, pos));
+		best_dis = _mm256_blendv_epi8(best_dis, dis, better);
+		best_pos = _mm256_blendv_epi8(best_pos, pos, better);
+		pos = _mm256_add_epi32(pos, step);
+	}
+
+	alignas(32) int32_t lane_dis[8], lane_pos[8];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lane_dis), best_dis);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lane_pos), best_pos);
+
+	int nearest_dis = unmatched_distance;
+	int32_t nearest_pos = -1;
+	for (size_t lane = 0; lane < 8u; lane++)
+	{
+		if (lane_pos[lane] < 0)
+			continue;
+		if (lane_dis[lane] < nearest_dis || (lane_dis[lane] == nearest_dis && lane_pos[lane] < nearest_pos))
+		{
+			nearest_dis = lane_dis[lane];
+			nearest_pos = lane_pos[lane];
+		}
+	}
+
+	return nearest_pos < 0 ? 1u : _soa_index[nearest_pos];
+#else
+	return scan_scalar(target);
+#endif
+}
+
+bool nearest_color::avx2_supported()
+{
+#ifdef NEAREST_COLOR_AVX2
+#ifdef _MSC_VER
+	int info[4] = { 0 };
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	//avx needs the os to save the ymm registers
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6u) != 6u)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+#else
+	return false;
+#endif
+}
+
+int nearest_color::distance(const color& color1, const color& color2)
+{
+	int dr = (int)color1.r - (int)color2.r;
+	int dg = (int)color1.g - (int)color2.g;
+	int db = (int)color1.b - (int)color2.b;
+
+	int rmean = ((int)color1.r + (int)color2.r) / 2;
+	return (((512 + rmean) * dr * dr) >> 8) + 4 * dg * dg + (((767 - rmean) * db * db) >> 8);
+}
+
+nearest_color::lab_color nearest_color::to_oklab(const color& rgb)
+{
+	const auto& linear = linear_table();
+	const float r = linear[rgb.r], g = linear[rgb.g], b = linear[rgb.b];
+
+	const float l = std::cbrt(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+	const float m = std::cbrt(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+	const float s = std::cbrt(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+
+	return {
+		0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s,
+		1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s,
+		0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s,
+	};
+}
+
+nearest_color::lab_color nearest_color::to_cielab(const color& rgb)
+{
+	const auto& linear = linear_table();
+	const float r = linear[rgb.r], g = linear[rgb.g], b = linear[rgb.b];
+
+	//d65 white
+	const float x = (0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / 0.95047f;
+	const float y = 0.2126729f * r + 0.7151522f * g + 0.0721750f * b;
+	const float z = (0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / 1.08883f;
+
+	auto f = [](const float t) {
+		constexpr const float delta = 6.0f / 29.0f;
+		return t > delta * delta * delta ? std::cbrt(t) : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+	};
+
+	const float fx = f(x), fy = f(y), fz = f(z);
+	return { 116.0f * fy - 16.0f,500.0f * (fx - fy),200.0f * (fy - fz) };
+}
+
+nearest_color::lab_color nearest_color::to_lab(const color& rgb) const
+{
+	return _metric == color_metric::cielab ? to_cielab(rgb) : to_oklab(rgb);
+}
+
+byte nearest_color::find_perceptual(const color& target) const
+{
+	float nearest_dis = std::numeric_limits<float>::infinity();
+	byte nearest_i = 1u;
+
+	if (_tree_root >= 0)
+		search_tree(_tree_root, to_lab(target), nearest_dis, nearest_i);
+
+	return nearest_i;
+}
+
+int32_t nearest_color::build_tree(byte* entries, const size_t count)
+{
+	if (!count)
+		return -1;
+
+	//median along the axis of the widest spread
+	lab_color low = _lab[entries[0]], high = _lab[entries[0]];
+	for (size_t i = 1; i < count; i++)
+	{
+		for (size_t axis = 0; axis < 3u; axis++)
+		{
+			low[axis] = std::min(low[axis], _lab[entries[i]][axis]);
+			high[axis] = std::max(high[axis], _lab[entries[i]][axis]);
+		}
+	}
+
+	byte axis = 0;
+	for (byte a = 1; a < 3u; a++)
+	{
+		if (high[a] - low[a] > high[axis] - low[axis])
+			axis = a;
+	}
+
+	const size_t middle = count / 2u;
+	std::nth_element(entries, entries + middle, entries + count, [this, axis](const byte l, const byte r) {
+		return _lab[l][axis] < _lab[r][axis];
+	});
+
+	const int32_t node_idx = static_cast<int32_t>(_tree.size());
+	_tree.push_back({ entries[middle],axis,-1,-1 });
+
+	const int32_t left = build_tree(entries, middle);
+	const int32_t right = build_tree(entries + middle + 1u, count - middle - 1u);
+	_tree[node_idx].left = left;
+	_tree[node_idx].right = right;
+	return node_idx;
+}
+
+void nearest_color::search_tree(const int32_t node_idx, const lab_color& target, float& nearest_dis, byte& nearest_i) const
+{
+	const auto& node = _tree[node_idx];
+	const auto& entry = _lab[node.entry];
+
+	//equally near entries are resolved by index, the tree order does not matter
+	const float dis = lab_sqdistance(entry, target);
+	if (dis < nearest_dis || (dis == nearest_dis && node.entry < nearest_i))
+	{
+		nearest_dis = dis;
+		nearest_i = node.entry;
+	}
+
+	const float plane = target[node.axis] - entry[node.axis];
+	const int32_t near_side = plane < 0.0f ? node.left : node.right;
+	const int32_t far_side = plane < 0.0f ? node.right : node.left;
+
+	if (near_side >= 0)
+		search_tree(near_side, target, nearest_dis, nearest_i);
+	if (far_side >= 0 && plane * plane <= nearest_dis)
+		search_tree(far_side, target, nearest_dis, nearest_i);
+}
+
+bool nearest_color::self_check()
+{
+	std::mt19937 engine(0x5eed);
+
+	//small selections keep the startup cheap, building the cells costs about as much as the entries selected
+	bool passed = true;
+	for (size_t round = 0; round < 2u; round++)
+	{
+		const auto nearest = random_table(engine, 8u);
+		for (const auto& query : random_colors(engine, 2000u))
+		{
+			const byte scalar = nearest.scan_scalar(query);
+			if (nearest.scan(query) != scalar || nearest.find(query) != scalar)
+			{
+				LOG(ERROR) << "Nearest color scan or find differs from the scalar loop, round " << round << ".\n";
+				passed = false;
+				break;
+			}
+		}
+	}
+
+	return passed;
+}
+
+void nearest_color::benchmark()
+{
+	std::mt19937 engine(0x5eed);
+
+	constexpr const size_t rounds = 4u;
+	constexpr const size_t targets = 200000u;
+
+	std::chrono::duration<double, std::milli> scalar_time{ 0.0 }, scan_time{ 0.0 };
+	size_t checksum = 0;
+	for (size_t round = 0; round < rounds; round++)
+	{
+		//the last round selects every entry, the others about half of them
+		const auto nearest = random_table(engine, round + 1u == rounds ? 1u : 2u);
+		const auto queries = random_colors(engine, targets);
+
+		auto start = std::chrono::steady_clock::now();
+		for (const auto& query : queries)
+			checksum += nearest.scan_scalar(query);
+		scalar_time += std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+		for (const auto& query : queries)
+			checksum -= nearest.scan(query);
+		scan_time += std::chrono::steady_clock::now() - start;
+	}
+
+	//the checksum keeps the loops from being dropped, equal results bring it back to 0
+	LOG(INFO) << "Nearest color over " << rounds * targets << " targets: scalar loop " << scalar_time.count() << " ms, "
+		<< (avx2_supported() ? "avx2 scan " : "scan without avx2 ") << scan_time.count() << " ms, checksum " << checksum << ".\n";
+}
+
+nearest_color nearest_color::random_table(std::mt19937& engine, const uint32_t one_in)
+{
+	std::uniform_int_distribution<uint32_t> channel(0u, 255u);
+
+	//palettes hold 6 bit channels, load shifts them up
+	std::array<color, 256> entries = {};
+	for (auto& entry : entries)
+		entry = { static_cast<byte>(channel(engine) >> 2), static_cast<byte>(channel(engine) >> 2), static_cast<byte>(channel(engine) >> 2) };
+
+	palette pal;
+	pal.load(entries.data());
+
+	std::vector<bool> selection(256, true);
+	if (one_in > 1u)
+		for (size_t i = 0; i < selection.size(); i++)
+			selection[i] = channel(engine) % one_in == 0;
+
+	nearest_color nearest;
+	nearest.build(pal, selection);
+	return nearest;
+}
+
+std::vector<color> nearest_color::random_colors(std::mt19937& engine, const size_t count)
+{
+	std::uniform_int_distribution<uint32_t> channel(0u, 255u);
+
+	std::vector<color> colors(count);
+	for (auto& target : colors)
+		target = { static_cast<byte>(channel(engine)), static_cast<byte>(channel(engine)), static_cast<byte>(channel(engine)) };
+	return colors;
+}
+
+size_t nearest_color::cell_index(const color& target)
+{
+	return (static_cast<size_t>(target.r >> cell_bits) << (2u * (8u - cell_bits)))
+		| (static_cast<size_t>(target.g >> cell_bits) << (8u - cell_bits))
+		| static_cast<size_t>(target.b >> cell_bits);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "pal.h"
+
+#include <array>
+#include <random>
+
+//how two colors are compared
+enum class color_metric : uint32_t
+{
+	redmean = 0,	//weighted rgb, the original vpl generator
+	oklab = 1,		//euclidean in oklab
+	cielab = 2,		//euclidean in cie l*a*b* under d65, delta e 1976
+};
+
+//parses redmean/oklab/cielab, anything else is redmean
+color_metric color_metric_from_string(const std::string& name);
+const char* to_string(const color_metric metric);
+
+//nearest palette color, built once per palette, color selection and metric
+//redmean: the rgb cube is split into 32^3 cells, each cell keeps the entries that can be the nearest to any color inside it
+//a query only measures the entries of its own cell, the result is the same as scanning the whole palette
+//oklab/cielab: the selected entries are converted once and kept in a k-d tree
+class nearest_color
+{
+public:
+	nearest_color() = default;
+	~nearest_color() = default;
+
+	//entries 1 to 255 take part when selected, 0 is never used
+	void build(const palette& pal, const std::vector<bool>& selection, const color_metric metric = color_metric::redmean);
+	//whether the tables were built from these inputs already
+	bool built_for(const palette& pal, const std::vector<bool>& selection, const color_metric metric = color_metric::redmean) const;
+	bool is_built() const;
+	color_metric metric() const;
+
+	//lowest index among the nearest entries, 1 when nothing is selected
+	//under redmean also 1 when nothing is nearer than 3*255*255
+	byte find(const color& target) const;
+	//same result as find, measures every selected entry, 8 at a time when the cpu has avx2
+	//the perceptual metrics always search the tree
+	byte scan(const color& target) const;
+	byte scan_scalar(const color& target) const;
+
+	static int distance(const color& color1, const color& color2);
+	static bool avx2_supported();
+	//runs scan and find against the scalar loop on a few random palettes, errors are logged
+	static bool self_check();
+	//times the scalar loop and scan over 800k random targets, the result is logged
+	static void benchmark();
+
+	using lab_color = std::array<float, 3>;
+	static lab_color to_oklab(const color& rgb);
+	static lab_color to_cielab(const color& rgb);
+
+private:
+	static constexpr const size_t cell_bits = 3u;
+	static constexpr const size_t cells_per_axis = 256u >> cell_bits;
+	static constexpr const int unmatched_distance = 3 * 255 * 255;
+
+	static size_t cell_index(const color& target);
+	//a random palette with each entry selected at a chance of 1 in one_in
+	static nearest_color random_table(std::mt19937& engine, const uint32_t one_in);
+	static std::vector<color> random_colors(std::mt19937& engine, const size_t count);
+	byte scan_avx2(const color& target) const;
+
+	lab_color to_lab(const color& rgb) const;
+	byte find_perceptual(const color& target) const;
+	int32_t build_tree(byte* entries, const size_t count);
+	void search_tree(const int32_t node, const lab_color& target, float& nearest_dis, byte& nearest_i) const;
+
+	//entry in the middle of its subtree, split along axis
+	struct tree_node
+	{
+		byte entry{ 0 };
+		byte axis{ 0 };
+		int32_t left{ -1 }, right{ -1 };
+	};
+
+	struct cell_range
+	{
+		uint32_t offset{ 0 };
+		uint32_t count{ 0 };
+	};
+
+	bool _built = false;
+	color_metric _metric = color_metric::redmean;
+	std::array<color, 256> _entries = {};
+	std::vector<bool> _selection;
+	std::vector<cell_range> _cells;
+	std::vector<byte> _candidates;
+
+	//selected entries as separate channel arrays, padded to a multiple of 8
+	size_t _selected_count = 0;
+	std::vector<int32_t> _soa_r, _soa_g, _soa_b;
+	std::vector<byte> _soa_index;
+
+	std::array<lab_color, 256> _lab = {};
+	std::vector<tree_node> _tree;
+	int32_t _tree_root = -1;
+};
@@ -1,5 +1,63 @@
 #include "pal.h"
 
+#include <cmath>
+#include <mutex>
+
+struct palette::table_cache
+{
+	//more keys than this start over, a slider sweep should not grow it forever
+	static constexpr const size_t max_tables = 64u;
+
+	std::mutex lock;
+	std::unordered_map<uint64_t, std::shared_ptr<const color_table>> remapped;
+};
+
+namespace
+{
+	//the shader helpers, kept in float so the ramp matches what the gpu produced
+	constexpr const float epsilon = 1e-10f;
+	constexpr const float pi = 3.1415926536f;
+
+	struct float3
+	{
+		float x, y, z;
+	};
+
+	float3 rgb_to_hsv(const float r, const float g, const float b)
+	{
+		//based on work by Sam Hocevar and Emil Persson
+		const bool gb = g < b;
+		const float p[4] = { gb ? b : g,gb ? g : b,gb ? -1.0f : 0.0f,gb ? 2.0f / 3.0f : -1.0f / 3.0f };
+		const bool rp = r < p[0];
+		const float q[4] = { rp ? p[0] : r,p[1],rp ? p[3] : p[2],rp ? r : p[0] };
+		const float c = q[0] - std::min(q[3], q[1]);
+		const float h = std::abs((q[3] - q[1]) / (6.0f * c + epsilon) + q[2]);
+		return { h,c / (q[0] + epsilon),q[0] };
+	}
+
+	float3 hsv_to_rgb(const float3& hsv)
+	{
+		const float r = std::clamp(std::abs(hsv.x * 6.0f - 3.0f) - 1.0f, 0.0f, 1.0f);
+		const float g = std::clamp(2.0f - std::abs(hsv.x * 6.0f - 2.0f), 0.0f, 1.0f);
+		const float b = std::clamp(2.0f - std::abs(hsv.x * 6.0f - 4.0f), 0.0f, 1.0f);
+		return { ((r - 1.0f) * hsv.y + 1.0f) * hsv.z,((g - 1.0f) * hsv.y + 1.0f) * hsv.z,((b - 1.0f) * hsv.y + 1.0f) * hsv.z };
+	}
+
+	//unorm conversion of the render target
+	inline byte to_unorm8(const float value)
+	{
+		return static_cast<byte>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	inline uint64_t table_key(const color& remap, const float extra_light, const bool light_all)
+	{
+		uint32_t light_bits = 0;
+		memcpy(&light_bits, &extra_light, sizeof light_bits);
+		return (static_cast<uint64_t>(light_all) << 56) | (static_cast<uint64_t>(light_bits) << 24) |
+			(static_cast<uint64_t>(remap.r) << 16) | (static_cast<uint64_t>(remap.g) << 8) | remap.b;
+	}
+}
+
 palette::palette(const std::string& filename) :palette()
 {
 	load(filename);
@@ -32,6 +90,7 @@ bool palette::load(const void* data)
 		color.b <<= 2;
 	}
 
+	_tables = make_tables();
 	return true;
 }
 
@@ -43,6 +102,7 @@ bool palette::is_loaded() const
 void palette::purge()
 {
 	memset(_entries, 0, sizeof _entries);
+	_tables = make_tables();
 }
 
 file_type palette::type() const
@@ -55,4 +115,57 @@ const color* palette::entry() const
 	return _entries;
 }
 
+std::shared_ptr<const color_table> palette::remapped(const color& remap, const float extra_light) const
+{
+	return find_table(remap, extra_light, false);
+}
+
+std::shared_ptr<const color_table> palette::lit(const color& remap, const float extra_light) const
+{
+	return find_table(remap, extra_light, true);
+}
+
+std::shared_ptr<const color_table> palette::find_table(const color& remap, const float extra_light, const bool light_all) const
+{
+	const uint64_t key = table_key(remap, extra_light, light_all);
+	{
+		std::lock_guard<std::mutex> guard(_tables->lock);
+		const auto found = _tables->remapped.find(key);
+		if (found != _tables->remapped.end())
+			return found->second;
+	}
+
+	auto table = std::make_shared<color_table>();
+	std::copy_n(_entries, table->size(), table->begin());
+	if (light_all)
+	{
+		const float scale = extra_light + 1.0f;
+		for (auto& entry : *table)
+			entry = { to_unorm8(entry.r / 255.0f * scale),to_unorm8(entry.g / 255.0f * scale),to_unorm8(entry.b / 255.0f * scale) };
+	}
+
+	const auto remap_hsv = rgb_to_hsv(remap.r / 255.0f, remap.g / 255.0f, remap.b / 255.0f);
+	for (size_t idx = 16u; idx < 32u; idx++)
+	{
+		const float i = static_cast<float>(idx - 16u);
+		float3 hsv = remap_hsv;
+		hsv.y = hsv.y * std::sin(i * pi / 67.5f + pi / 3.6f);
+		hsv.z = hsv.z * std::cos(i * 7.0f * pi / 270.0f + pi / 9.0f);
+
+		const auto rgb = hsv_to_rgb(hsv);
+		(*table)[idx] = { to_unorm8(rgb.x * (extra_light + 1.0f)),to_unorm8(rgb.y * (extra_light + 1.0f)),to_unorm8(rgb.z * (extra_light + 1.0f)) };
+	}
+
+	std::lock_guard<std::mutex> guard(_tables->lock);
+	if (_tables->remapped.size() >= table_cache::max_tables)
+		_tables->remapped.clear();
+	_tables->remapped.emplace(key, table);
+	return table;
+}
+
+std::shared_ptr<palette::table_cache> palette::make_tables()
+{
+	return std::make_shared<table_cache>();
+}
+
 
@@ -2,6 +2,10 @@
 
 #include "filedefinitions.h"
 
+#include <array>
+
+using color_table = std::array<color, 256>;
+
 class palette : public game_file
 {
 public:
@@ -17,6 +21,19 @@ public:
 	virtual file_type type() const final;
 
 	const color* entry() const;
+
+	//entries 16 to 31 replaced by the house color ramp of remap, as the shaders computed it per pixel
+	//extra_light brightens the ramp only, as the compute path shows it, saturated once and cached per key
+	std::shared_ptr<const color_table> remapped(const color& remap, const float extra_light = 0.0f) const;
+	//same with every entry brightened by extra_light, as the box path shows it
+	std::shared_ptr<const color_table> lit(const color& remap, const float extra_light) const;
+
 private:
+	struct table_cache;
+	static std::shared_ptr<table_cache> make_tables();
+	std::shared_ptr<const color_table> find_table(const color& remap, const float extra_light, const bool light_all) const;
+
 	color _entries[256]{ 0 };
+	//copies share the tables until one of them loads other data
+	std::shared_ptr<table_cache> _tables = make_tables();
 };
\ No newline at end of file
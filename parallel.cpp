@@ -0,0 +1,27 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <thread>
+
+size_t hardware_thread_count()
+{
+	return std::max<size_t>(std::thread::hardware_concurrency(), 1u);
+}
+
+void parallel_for(const size_t task_count, const size_t thread_count, const std::function<void(size_t)>& task)
+{
+	std::atomic<size_t> next = 0;
+	auto worker = [&]() {
+		for (size_t i = next++; i < task_count; i = next++)
+			task(i);
+	};
+
+	const size_t helpers = std::min(thread_count ? thread_count : hardware_thread_count(), task_count);
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < helpers; i++)
+		threads.emplace_back(worker);
+
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "general_headers.h"
+
+#include <functional>
+
+//hardware threads, at least 1
+size_t hardware_thread_count();
+
+//runs task(0) to task(task_count - 1) on up to thread_count threads, the calling thread included
+//0 threads uses every hardware thread, tasks are handed out in order but may finish in any order
+void parallel_for(const size_t task_count, const size_t thread_count, const std::function<void(size_t)>& task);
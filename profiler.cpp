@@ -0,0 +1,179 @@
+#include "profiler.h"
+#include "log.h"
+
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+std::atomic<bool> profiler::_enabled = false;
+std::atomic<int64_t> profiler::_origin = 0;
+std::mutex profiler::_buffers_lock;
+std::vector<std::unique_ptr<profiler::thread_buffer>> profiler::_buffers;
+
+void profiler::enable(const bool enable)
+{
+	if (enable && !enabled())
+		_origin.store(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+
+	_enabled.store(enable, std::memory_order_relaxed);
+}
+
+void profiler::clear()
+{
+	std::lock_guard<std::mutex> lock(_buffers_lock);
+	for (auto& buffer : _buffers)
+	{
+		buffer->events.clear();
+		buffer->open.clear();
+	}
+}
+
+void profiler::begin(const char* name)
+{
+	thread_buffer& buffer = local_buffer();
+	buffer.open.emplace_back(buffer.events.size(), 0);
+	buffer.events.push_back({ name,now(),0,0,0,static_cast<uint32_t>(buffer.open.size() - 1),false });
+}
+
+void profiler::end()
+{
+	thread_buffer& buffer = local_buffer();
+	if (buffer.open.empty())
+		return;
+
+	//a scope that was open across clear() has no event left
+	const auto [index, children] = buffer.open.back();
+	buffer.open.pop_back();
+	if (index >= buffer.events.size())
+		return;
+
+	event& closed = buffer.events[index];
+	closed.duration = now() - closed.start;
+	closed.self = closed.duration - std::min(children, closed.duration);
+	if (!buffer.open.empty())
+		buffer.open.back().second += closed.duration;
+}
+
+void profiler::count(const char* name, const int64_t value)
+{
+	thread_buffer& buffer = local_buffer();
+	buffer.events.push_back({ name,now(),0,0,value,static_cast<uint32_t>(buffer.open.size()),true });
+}
+
+std::vector<profiler::stage> profiler::summary()
+{
+	//names are literals, the same text may still live at different addresses
+	std::map<std::string, stage> stages;
+	{
+		std::lock_guard<std::mutex> lock(_buffers_lock);
+		for (const auto& buffer : _buffers)
+		{
+			for (const auto& recorded : buffer->events)
+			{
+				if (recorded.counter)
+					continue;
+
+				stage& row = stages[recorded.name];
+				row.name = recorded.name;
+				row.calls++;
+				row.total += recorded.duration;
+				row.self += recorded.self;
+				row.max = std::max(row.max, recorded.duration);
+			}
+		}
+	}
+
+	std::vector<stage> result;
+	for (const auto& row : stages)
+		result.push_back(row.second);
+
+	std::sort(result.begin(), result.end(), [](const stage& l, const stage& r) { return l.total > r.total; });
+	return result;
+}
+
+std::string profiler::summary_table()
+{
+	std::stringstream table;
+	table << std::left << std::setw(32) << "stage" << std::right << std::setw(8) << "calls"
+		<< std::setw(12) << "total ms" << std::setw(12) << "self ms" << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << "\n";
+
+	table << std::fixed << std::setprecision(3);
+	for (const auto& row : summary())
+	{
+		table << std::left << std::setw(32) << row.name << std::right << std::setw(8) << row.calls
+			<< std::setw(12) << row.total / 1.0e6 << std::setw(12) << row.self / 1.0e6
+			<< std::setw(12) << row.total / 1.0e6 / row.calls << std::setw(12) << row.max / 1.0e6 << "\n";
+	}
+
+	return table.str();
+}
+
+bool profiler::write_trace(const std::filesystem::path& path)
+{
+	std::ofstream output(path);
+	if (!output)
+	{
+		LOG(ERROR) << "Failed to write trace " << path.string() << ".\n";
+		return false;
+	}
+
+	auto write_name = [&](const char* name) {
+		output << '"';
+		for (const char* c = name; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				output << '\\';
+			output << *c;
+		}
+		output << '"';
+	};
+
+	//complete events for scopes, counter events for counts, times in microseconds
+	output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	output << std::fixed << std::setprecision(3);
+	bool first = true;
+	std::lock_guard<std::mutex> lock(_buffers_lock);
+	for (const auto& buffer : _buffers)
+	{
+		for (const auto& recorded : buffer->events)
+		{
+			output << (first ? "" : ",\n") << "{\"name\":";
+			write_name(recorded.name);
+			output << ",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"ts\":" << recorded.start / 1.0e3;
+			if (recorded.counter)
+			{
+				output << ",\"ph\":\"C\",\"args\":{";
+				write_name(recorded.name);
+				output << ":" << recorded.value << "}}";
+			}
+			else
+				output << ",\"ph\":\"X\",\"dur\":" << recorded.duration / 1.0e3 << "}";
+			first = false;
+		}
+	}
+	output << "\n]}\n";
+
+	return !!output;
+}
+
+profiler::thread_buffer& profiler::local_buffer()
+{
+	//buffers are owned by the profiler, a thread that exits leaves its events behind
+	thread_local thread_buffer* buffer = nullptr;
+	if (!buffer)
+	{
+		std::lock_guard<std::mutex> lock(_buffers_lock);
+		_buffers.push_back(std::make_unique<thread_buffer>());
+		buffer = _buffers.back().get();
+		buffer->thread_id = static_cast<uint32_t>(_buffers.size());
+		buffer->events.reserve(4096);
+	}
+
+	return *buffer;
+}
+
+uint64_t profiler::now()
+{
+	const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	return static_cast<uint64_t>(std::max<int64_t>(ns - _origin.load(std::memory_order_relaxed), 0));
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "general_headers.h"
+
+#include <atomic>
+#include <mutex>
+
+//scoped timers and counters, every thread records into its own buffer without locking
+//the results are exported as a chrome/perfetto trace and as a summary table
+//exporting and clearing expect the recording threads to be idle
+class profiler
+{
+public:
+	struct event
+	{
+		const char* name;
+		uint64_t start;		//ns since the profiler was enabled
+		uint64_t duration;	//ns, 0 for counters
+		uint64_t self;		//ns not spent in nested scopes
+		int64_t value;		//counters only
+		uint32_t depth;
+		bool counter;
+	};
+
+	//one row of the summary
+	struct stage
+	{
+		const char* name = nullptr;
+		size_t calls = 0;
+		uint64_t total = 0;
+		uint64_t self = 0;
+		uint64_t max = 0;
+	};
+
+	static void enable(const bool enable);
+	static bool enabled()
+	{
+		return _enabled.load(std::memory_order_relaxed);
+	}
+	static void clear();
+
+	//name has to outlive the profiler, string literals are expected
+	static void begin(const char* name);
+	static void end();
+	static void count(const char* name, const int64_t value);
+
+	//stages sorted by total time
+	static std::vector<stage> summary();
+	static std::string summary_table();
+	static bool write_trace(const std::filesystem::path& path);
+
+private:
+	struct thread_buffer
+	{
+		uint32_t thread_id = 0;
+		std::vector<event> events;
+		//open scopes, the time spent in their children
+		std::vector<std::pair<size_t, uint64_t>> open;
+	};
+
+	static thread_buffer& local_buffer();
+	static uint64_t now();
+
+	static std::atomic<bool> _enabled;
+	static std::atomic<int64_t> _origin;
+	static std::mutex _buffers_lock;
+	static std::vector<std::unique_ptr<thread_buffer>> _buffers;
+};
+
+//times the rest of the enclosing block
+class profile_scope
+{
+public:
+	explicit profile_scope(const char* name) : _active(profiler::enabled())
+	{
+		if (_active)
+			profiler::begin(name);
+	}
+
+	~profile_scope()
+	{
+		if (_active)
+			profiler::end();
+	}
+
+	profile_scope(const profile_scope&) = delete;
+	profile_scope& operator=(const profile_scope&) = delete;
+
+private:
+	const bool _active;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) profile_scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNT(name, value) if (!profiler::enabled()) ; else profiler::count(name, value)
@@ -0,0 +1,199 @@
+#include "quantizer.h"
+#include "parallel.h"
+
+namespace
+{
+	constexpr const byte bayer8[8][8] =
+	{
+		{ 0,32, 8,40, 2,34,10,42},
+		{48,16,56,24,50,18,58,26},
+		{12,44, 4,36,14,46, 6,38},
+		{60,28,52,20,62,30,54,22},
+		{ 3,35,11,43, 1,33, 9,41},
+		{51,19,59,27,49,17,57,25},
+		{15,47, 7,39,13,45, 5,37},
+		{63,31,55,23,61,29,53,21},
+	};
+
+	inline byte clamp_channel(const int value)
+	{
+		return static_cast<byte>(std::clamp(value, 0, 255));
+	}
+}
+
+dither_mode dither_mode_from_string(const std::string& name)
+{
+	std::string lower = name;
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](const char c) { return static_cast<char>(tolower(c)); });
+
+	if (lower == "ordered" || lower == "bayer")
+		return dither_mode::ordered;
+	if (lower == "floyd" || lower == "floyd_steinberg" || lower == "floyd-steinberg")
+		return dither_mode::floyd_steinberg;
+	return dither_mode::none;
+}
+
+bool palette_quantizer::set_palette(const palette& pal, const std::vector<bool>& selection, const color_metric metric)
+{
+	if (!pal.is_loaded())
+	{
+		LOG(ERROR) << "Quantizer needs a loaded palette.\n";
+		return false;
+	}
+
+	std::vector<bool> targets = selection;
+	if (targets.empty())
+		targets.assign(256u, true);
+	targets.resize(256u, false);
+	targets[0] = false;
+
+	std::copy_n(pal.entry(), _entries.size(), _entries.begin());
+	if (!_nearest.built_for(pal, targets, metric))
+		_nearest.build(pal, targets, metric);
+
+	return true;
+}
+
+bool palette_quantizer::is_ready() const
+{
+	return _nearest.is_built();
+}
+
+void palette_quantizer::set_thread_count(const size_t count)
+{
+	_thread_count = count;
+}
+
+void palette_quantizer::set_alpha_threshold(const byte threshold)
+{
+	_alpha_threshold = threshold;
+}
+
+bool palette_quantizer::quantize(const byte* rgba, const size_t width, const size_t height, const size_t pitch,
+	std::vector<byte>& indices, const dither_mode mode) const
+{
+	if (!is_ready() || !rgba || !width || !height || pitch < width * 4u)
+	{
+		LOG(ERROR) << "Invalid quantizer input.\n";
+		return false;
+	}
+
+	indices.resize(width * height);
+
+	//bands are the unit of work for every mode, so the split never depends on the thread count
+	const size_t bands = (height + band_rows - 1u) / band_rows;
+	parallel_for(bands, _thread_count, [&](const size_t band) {
+		const size_t first_row = band * band_rows;
+		const size_t rows = std::min(band_rows, height - first_row);
+
+		if (mode == dither_mode::floyd_steinberg)
+			diffuse_rows(rgba, width, pitch, first_row, rows, indices.data());
+		else
+			quantize_rows(rgba, width, pitch, first_row, rows, indices.data(), mode);
+	});
+
+	return true;
+}
+
+bool palette_quantizer::expand(const std::vector<byte>& indices, const size_t width, const size_t height, std::vector<byte>& rgba) const
+{
+	if (indices.size() < width * height)
+		return false;
+
+	rgba.resize(width * height * 4u);
+	for (size_t i = 0; i < width * height; i++)
+	{
+		const byte index = indices[i];
+		const auto& entry = _entries[index];
+		byte* pixel = &rgba[i * 4u];
+		pixel[0] = index ? entry.r : 0;
+		pixel[1] = index ? entry.g : 0;
+		pixel[2] = index ? entry.b : 0;
+		pixel[3] = index ? 255u : 0;
+	}
+
+	return true;
+}
+
+void palette_quantizer::quantize_rows(const byte* rgba, const size_t width, const size_t pitch, const size_t first_row, const size_t rows,
+	byte* indices, const dither_mode mode) const
+{
+	for (size_t y = first_row; y < first_row + rows; y++)
+	{
+		const byte* src = rgba + y * pitch;
+		byte* dst = indices + y * width;
+
+		for (size_t x = 0; x < width; x++)
+		{
+			const byte* pixel = &src[x * 4u];
+			if (pixel[3] < _alpha_threshold)
+			{
+				dst[x] = 0;
+				continue;
+			}
+
+			color target = { pixel[0],pixel[1],pixel[2] };
+			if (mode == dither_mode::ordered)
+			{
+				//threshold in (-0.5, 0.5) of the spread
+				const int offset = ((bayer8[y & 7u][x & 7u] * 2 + 1) * ordered_spread) / 128 - ordered_spread / 2;
+				target = { clamp_channel(pixel[0] + offset),clamp_channel(pixel[1] + offset),clamp_channel(pixel[2] + offset) };
+			}
+
+			dst[x] = _nearest.find(target);
+		}
+	}
+}
+
+void palette_quantizer::diffuse_rows(const byte* rgba, const size_t width, const size_t pitch, const size_t first_row, const size_t rows,
+	byte* indices) const
+{
+	//errors in 1/16 units, one pixel of padding on both sides, current and next row
+	std::vector<int> errors[2] = { std::vector<int>((width + 2u) * 3u, 0),std::vector<int>((width + 2u) * 3u, 0) };
+
+	for (size_t y = first_row; y < first_row + rows; y++)
+	{
+		const byte* src = rgba + y * pitch;
+		byte* dst = indices + y * width;
+		auto& current = errors[(y - first_row) & 1u];
+		auto& next = errors[((y - first_row) & 1u) ^ 1u];
+		std::fill(next.begin(), next.end(), 0);
+
+		//serpentine order keeps the error from drifting to one side
+		const bool reverse = ((y - first_row) & 1u) != 0;
+		const ptrdiff_t step = reverse ? -1 : 1;
+		for (size_t i = 0; i < width; i++)
+		{
+			const size_t x = reverse ? width - 1u - i : i;
+			const byte* pixel = &src[x * 4u];
+			const size_t e = (x + 1u) * 3u;
+
+			if (pixel[3] < _alpha_threshold)
+			{
+				dst[x] = 0;
+				continue;
+			}
+
+			const int wanted[3] =
+			{
+				std::clamp(pixel[0] + current[e] / 16, 0, 255),
+				std::clamp(pixel[1] + current[e + 1u] / 16, 0, 255),
+				std::clamp(pixel[2] + current[e + 2u] / 16, 0, 255),
+			};
+
+			const byte index = _nearest.find({ static_cast<byte>(wanted[0]),static_cast<byte>(wanted[1]),static_cast<byte>(wanted[2]) });
+			dst[x] = index;
+
+			const auto& got = _entries[index];
+			const int error[3] = { wanted[0] - got.r,wanted[1] - got.g,wanted[2] - got.b };
+			const size_t ahead = e + step * 3, behind = e - step * 3;
+			for (size_t c = 0; c < 3u; c++)
+			{
+				current[ahead + c] += error[c] * 7;
+				next[behind + c] += error[c] * 3;
+				next[e + c] += error[c] * 5;
+				next[ahead + c] += error[c];
+			}
+		}
+	}
+}
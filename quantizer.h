@@ -0,0 +1,53 @@
+#pragma once
+
+#include "nearest_color.h"
+
+enum class dither_mode : uint32_t
+{
+	none = 0,
+	ordered = 1,			//8x8 bayer threshold map
+	floyd_steinberg = 2,	//error diffusion, serpentine inside bands of rows
+};
+
+//parses none/ordered/floyd, anything else is none
+dither_mode dither_mode_from_string(const std::string& name);
+
+//maps rgba images to palette indices through a nearest color engine built once per palette
+//index 0 is kept for transparent pixels, rows are processed in parallel
+class palette_quantizer
+{
+public:
+	palette_quantizer() = default;
+	~palette_quantizer() = default;
+
+	//an empty selection means entries 1 to 255, the engine is only rebuilt when the inputs change
+	bool set_palette(const palette& pal, const std::vector<bool>& selection = {}, const color_metric metric = color_metric::redmean);
+	bool is_ready() const;
+
+	//0 uses every hardware thread
+	void set_thread_count(const size_t count);
+	//pixels with a lower alpha become index 0
+	void set_alpha_threshold(const byte threshold);
+
+	//rgba rows pitch bytes apart, one index per pixel in the result
+	//error diffusion restarts every band_rows rows, the result does not depend on the thread count
+	bool quantize(const byte* rgba, const size_t width, const size_t height, const size_t pitch,
+		std::vector<byte>& indices, const dither_mode mode = dither_mode::none) const;
+	//indices back to rgba through the palette, index 0 is transparent black
+	bool expand(const std::vector<byte>& indices, const size_t width, const size_t height, std::vector<byte>& rgba) const;
+
+private:
+	static constexpr const size_t band_rows = 64u;
+	//amplitude of the ordered dither offsets
+	static constexpr const int ordered_spread = 24;
+
+	void quantize_rows(const byte* rgba, const size_t width, const size_t pitch, const size_t first_row, const size_t rows,
+		byte* indices, const dither_mode mode) const;
+	void diffuse_rows(const byte* rgba, const size_t width, const size_t pitch, const size_t first_row, const size_t rows,
+		byte* indices) const;
+
+	nearest_color _nearest;
+	std::array<color, 256> _entries = {};
+	size_t _thread_count = 0;
+	byte _alpha_threshold = 128u;
+};
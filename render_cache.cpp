@@ -0,0 +1,28 @@
+#include "render_cache.h"
+
+render_cache::render_cache() :blob_store("VXLFRM02", ".frame", "render cache")
+{
+}
+
+bool render_cache::fetch(const hash128& key, cropped_frame& frame) const
+{
+	return blob_store::fetch(key, [&frame](std::istream& input) { return frame.read(input); });
+}
+
+bool render_cache::store(const hash128& key, const cropped_frame& frame) const
+{
+	return frame.valid() && blob_store::store(key, [&frame](std::ostream& output) { return frame.write(output); });
+}
+
+hash128 render_cache::file_digest(const std::filesystem::path& path)
+{
+	std::error_code error;
+	if (path.empty() || !std::filesystem::is_regular_file(path, error))
+		return murmur3_128(nullptr, 0);
+
+	std::ifstream input(path, std::ios::binary);
+	std::vector<byte> data(std::filesystem::file_size(path, error));
+	input.read(reinterpret_cast<char*>(data.data()), data.size());
+
+	return murmur3_128(data.data(), static_cast<size_t>(input.gcount()));
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "frame.h"
+#include "blob_store.h"
+
+//rendered frames on disk, the file name is the digest of every input of the render
+class render_cache : public blob_store
+{
+public:
+	render_cache();
+	~render_cache() = default;
+
+	bool fetch(const hash128& key, cropped_frame& frame) const;
+	bool store(const hash128& key, const cropped_frame& frame) const;
+
+	//content digest of a file, a missing file gives the digest of nothing
+	static hash128 file_digest(const std::filesystem::path& path);
+};
@@ -0,0 +1,46 @@
+#include "render_stats.h"
+
+#include <iomanip>
+#include <sstream>
+
+double render_stats::overdraw() const
+{
+	return pixels_covered ? static_cast<double>(pixels_written) / pixels_covered : 0.0;
+}
+
+render_stats& render_stats::operator+=(const render_stats& rhs)
+{
+	voxels_submitted += rhs.voxels_submitted;
+	primitives_submitted += rhs.primitives_submitted;
+	faces_culled = faces_culled || rhs.faces_culled;
+	backface_culled += rhs.backface_culled;
+	off_canvas += rhs.off_canvas;
+	//an empty sum takes the exactness of the first render added
+	depth_rejects_exact = renders ? depth_rejects_exact && rhs.depth_rejects_exact : rhs.depth_rejects_exact;
+	depth_rejected += rhs.depth_rejected;
+	pixels_written += rhs.pixels_written;
+	pixels_covered += rhs.pixels_covered;
+	renders += rhs.renders;
+	return *this;
+}
+
+std::string render_stats::summary() const
+{
+	std::stringstream table;
+	table << std::left << std::setw(24) << "renders" << renders << "\n"
+		<< std::setw(24) << "voxels submitted" << voxels_submitted << "\n"
+		<< std::setw(24) << "primitives submitted" << primitives_submitted << "\n"
+		<< std::setw(24) << "backface culled";
+	if (faces_culled)
+		table << backface_culled << "\n";
+	else
+		table << "n/a, faces are not culled\n";
+
+	table << std::setw(24) << "off canvas" << off_canvas << "\n"
+		<< std::setw(24) << "depth rejected" << depth_rejected << (depth_rejects_exact ? "\n" : " (lower bound, early depth rejects are not counted)\n")
+		<< std::setw(24) << "pixels written" << pixels_written << "\n"
+		<< std::setw(24) << "pixels covered" << pixels_covered << "\n"
+		<< std::setw(24) << "overdraw" << std::fixed << std::setprecision(3) << overdraw() << "\n";
+
+	return table.str();
+}
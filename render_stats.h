@@ -0,0 +1,28 @@
+#pragma once
+
+#include "general_headers.h"
+
+//what one render did, summed over its sections
+//primitives are voxel splats for the software renderers and triangles for the box pipeline
+struct render_stats
+{
+	uint64_t voxels_submitted = 0;
+	uint64_t primitives_submitted = 0;
+	//only the software renderer tests faces, the box pipelines draw every face and leave the back ones to the depth test
+	bool faces_culled = false;
+	uint64_t backface_culled = 0;
+	uint64_t off_canvas = 0;
+	//fragments that lost the depth test after they were produced
+	//the gpu rejects some before the pixel shader without counting them, there it is a lower bound
+	bool depth_rejects_exact = false;
+	uint64_t depth_rejected = 0;
+	uint64_t pixels_written = 0;
+	//distinct pixels left in the image, 0 until a frame has been read back
+	uint64_t pixels_covered = 0;
+	uint64_t renders = 0;
+
+	//pixels written per covered pixel, 0 when the coverage is unknown
+	double overdraw() const;
+	render_stats& operator+=(const render_stats& rhs);
+	std::string summary() const;
+};
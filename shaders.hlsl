@@ -16,6 +16,7 @@ cbuffer hva_buffer_data : register(b5)
     row_major float4x4 transformation_matrix;
     float4 remap_color;
     float section_buffer_size;
+    row_major float4x4 shadow_transformation;
 };
 
 struct vxl_buffer_decl
@@ -56,40 +57,6 @@ float3 vxl_projection(float3 model_pos)
     return result;
 }
 
-static const float Epsilon = 1e-10;
-static const float pi = 3.1415926536;
-
-float3 RGBtoHCV(in float3 RGB)
-{
-    // Based on work by Sam Hocevar and Emil Persson
-    float4 P = (RGB.g < RGB.b) ? float4(RGB.bg, -1.0, 2.0 / 3.0) : float4(RGB.gb, 0.0, -1.0 / 3.0);
-    float4 Q = (RGB.r < P.x) ? float4(P.xyw, RGB.r) : float4(RGB.r, P.yzx);
-    float C = Q.x - min(Q.w, Q.y);
-    float H = abs((Q.w - Q.y) / (6 * C + Epsilon) + Q.z);
-    return float3(H, C, Q.x);
-}
-
-float3 RGBtoHSV(in float3 RGB)
-{
-    float3 HCV = RGBtoHCV(RGB);
-    float S = HCV.y / (HCV.z + Epsilon);
-    return float3(HCV.x, S, HCV.z);
-}
-
-float3 HUEtoRGB(in float H)
-{
-    float R = abs(H * 6 - 3) - 1;
-    float G = 2 - abs(H * 6 - 2);
-    float B = 2 - abs(H * 6 - 4);
-    return saturate(float3(R, G, B));
-}
-
-float3 HSVtoRGB(in float3 HSV)
-{
-    float3 RGB = HUEtoRGB(HSV.x);
-    return ((RGB - 1) * HSV.y + 1) * HSV.z;
-}
-
 float clamp_zero(float f)
 {
     return f > 0.0f ? f : 0.0f;
@@ -158,18 +125,8 @@ float4 pmain(vs_output input) : SV_Target
     uint2 pix_coord = input.uv * canvas_dimension_extralight.xy;
     uint color_idx = render_target[pix_coord].x;
     uint color_offset = color_idx * 3;
+    //the house color ramp and its extra light are baked into entries 16 to 31 of the palette on the cpu
     float3 color = float3(pal_data[color_offset], pal_data[color_offset + 1], pal_data[color_offset + 2]);
-    if (color_idx >= 16 && color_idx < 32)
-    {
-        float i = color_idx - 16;
-        color.rgb = RGBtoHSV(remap.rgb / 255.0f);
-        color.r = color.r;
-        color.g = color.g * sin(i * pi / 67.5f + pi / 3.6f);
-        color.b = color.b * cos(i * 7.0f * pi / 270.0f + pi / 9.0f);
-        color.rgb = HSVtoRGB(color.rgb) * (canvas_dimension_extralight.z + 1.0f);
-        return float4(color, 1.0f);
-    }
-    
     return float4(color / 255.0f, 1.0f);
 }
 
@@ -213,24 +170,11 @@ box_vert_output box_vmain(float4 position : POSITION, uint instance_id : SV_Inst
     float f2 = dot(n, l2) / (d - (d - 1.0f) * dot(n, l2));
     uint i = 16 * (clamp_zero(f1) + clamp_zero(f2));
     uint real_color_index = vpl_data[i * 256 + voxel.color];
-    float4 real_color;
     
-    uint color_offset = real_color_index * 3;
+    //the box path table follows the compute one, every entry is lit on the cpu
+    uint color_offset = 3 * 256 + real_color_index * 3;
     float3 color = float3(pal_data[color_offset], pal_data[color_offset + 1], pal_data[color_offset + 2]);
-    if (real_color_index >= 16 && real_color_index < 32)
-    {
-        float i = real_color_index - 16;
-        color.rgb = RGBtoHSV(remap.rgb / 255.0f);
-        color.r = color.r;
-        color.g = color.g * sin(i * pi / 67.5f + pi / 3.6f);
-        color.b = color.b * cos(i * 7.0f * pi / 270.0f + pi / 9.0f);
-        color.rgb = HSVtoRGB(color.rgb);
-        real_color = float4(color, 1.0f);
-    }
-    else
-    {
-        real_color = float4(color / 255.0f, 1.0f);
-    }
+    float4 real_color = float4(color / 255.0f, 1.0f);
     
     proj_voxel_pos.xy /= canvas_dimension_extralight.xy / 2.0f;
     proj_voxel_pos.xy -= 1.0f.xx;
@@ -239,7 +183,7 @@ box_vert_output box_vmain(float4 position : POSITION, uint instance_id : SV_Inst
     box_vert_output output;
     
     output.position = float4(proj_voxel_pos, 1.0f);
-    output.color = real_color * (canvas_dimension_extralight.z + 1.0f);
+    output.color = real_color;
     
     return output;
 }
@@ -247,4 +191,73 @@ box_vert_output box_vmain(float4 position : POSITION, uint instance_id : SV_Inst
 float4 box_pmain(box_vert_output input) : SV_Target
 {
     return input.color;
+}
+
+struct box_shadow_vert_output
+{
+    float4 position : SV_Position;
+    float4 color : COLOR;
+    float4 shadow_position : SHADOW_POSITION;
+};
+
+box_shadow_vert_output box_shadow_vmain(float4 position : POSITION, uint instance_id : SV_InstanceID)
+{
+    static const uint max_byte_per_row = 16000;
+    
+    box_vert_output color_output = box_vmain(position, instance_id);
+    
+    uint byte_address = instance_id * 5;
+    uint row = byte_address / max_byte_per_row;
+    uint xoffset = byte_address - row * max_byte_per_row;
+    float4 modelspace_pos = float4(vxl_data[uint2(xoffset + 2, row)], vxl_data[uint2(xoffset + 3, row)], vxl_data[uint2(xoffset + 4, row)], 1.0f);
+    modelspace_pos.xyz += position.xyz;
+    
+    //same projection as the color, with the flattened world
+    float4 shadow_pos = mul(modelspace_pos, shadow_transformation);
+    shadow_pos.xyz *= scale_factor.xyz;
+    float3 proj_shadow_pos = vxl_projection(shadow_pos.xyz);
+    proj_shadow_pos.xy /= canvas_dimension_extralight.xy / 2.0f;
+    proj_shadow_pos.xy -= 1.0f.xx;
+    proj_shadow_pos.y *= -1.0f;
+    proj_shadow_pos.z += 0.5f;
+    
+    box_shadow_vert_output output;
+    output.position = color_output.position;
+    output.color = color_output.color;
+    output.shadow_position = float4(proj_shadow_pos, 1.0f);
+    
+    return output;
+}
+
+struct box_geom_output
+{
+    float4 position : SV_Position;
+    float4 color : COLOR;
+    uint slice : SV_RenderTargetArrayIndex;
+};
+
+//slice 0 gets the colored box, slice 1 its shadow coverage
+[maxvertexcount(6)]
+void box_gmain(triangle box_shadow_vert_output input[3], inout TriangleStream<box_geom_output> output)
+{
+    box_geom_output vertex;
+    
+    [unroll]
+    for (uint i = 0; i < 3; i++)
+    {
+        vertex.position = input[i].position;
+        vertex.color = input[i].color;
+        vertex.slice = 0;
+        output.Append(vertex);
+    }
+    output.RestartStrip();
+    
+    [unroll]
+    for (uint j = 0; j < 3; j++)
+    {
+        vertex.position = input[j].shadow_position;
+        vertex.color = float4(0.0f, 0.0f, 0.0f, 1.0f);
+        vertex.slice = 1;
+        output.Append(vertex);
+    }
 }
\ No newline at end of file
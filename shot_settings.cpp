@@ -0,0 +1,39 @@
+#include "shot_settings.h"
+
+#include <limits>
+
+const config_schema<shot_settings>& shot_settings::schema()
+{
+	static const config_schema<shot_settings> settings = config_schema<shot_settings>("Settings")
+		.field("ScreenshotOutputDir", &shot_settings::output_dir)
+		.field("DirectionCount", &shot_settings::directions, static_cast<size_t>(1u), static_cast<size_t>(256u))
+		.field("BackgroundFileName", &shot_settings::bgfilename)
+		.field("CellOffsetX", &shot_settings::celloffsetx, static_cast<size_t>(0u), static_cast<size_t>(64u))
+		.field("CellOffsetY", &shot_settings::celloffsety, static_cast<size_t>(0u), static_cast<size_t>(64u))
+		.field("BackgroundColor", &shot_settings::background_color, 0, 255)
+		.field("GenerateIngameViews", &shot_settings::generate_ingame_like_previews)
+		.field("GenerateShadow", &shot_settings::generate_shadow)
+		.field("IntegratedShadow", &shot_settings::generate_integrated_shadow)
+		.field("CropFrames", &shot_settings::crop_frames)
+		.field("DeduplicateFrames", &shot_settings::deduplicate_frames)
+		.field("RenderCache", &shot_settings::use_render_cache)
+		.field("SinglePassShadow", &shot_settings::single_pass_shadow)
+		.field("WriteFrameSchedule", &shot_settings::write_schedule)
+		.field("QuantizeBackground", &shot_settings::quantize_background)
+		.field("BackgroundDither", &shot_settings::background_dither, dither_mode_from_string)
+		.field("RenderCacheDir", &shot_settings::render_cache_dir)
+		.field("VplThreads", &shot_settings::vpl_threads, static_cast<size_t>(0u), static_cast<size_t>(256u))
+		.field("VplCache", &shot_settings::vpl_cache)
+		.field("VplCacheDir", &shot_settings::vpl_cache_dir)
+		.field("DefaultLightDir", &shot_settings::light_direction, std::numeric_limits<float>::lowest(), std::numeric_limits<float>::max())
+		.field("ColorMetric", &shot_settings::default_metric, color_metric_from_string)
+		.field("Profile", &shot_settings::profile)
+		.field("LogLevel", &shot_settings::logging, log_level_from_string);
+
+	return settings;
+}
+
+bool shot_settings::load(const config& ini)
+{
+	return schema().apply(ini, *this);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "config_schema.h"
+#include "quantizer.h"
+
+//everything a shot reads from [Settings], loaded once and then only read
+//a batch can hand the same copy to every worker
+struct shot_settings
+{
+	size_t directions = 8;
+	std::string output_dir = "output";
+	std::string bgfilename = "background.png";
+	size_t celloffsetx = 6;
+	size_t celloffsety = 6;
+	std::optional<std::array<int, 4>> background_color;
+
+	bool generate_ingame_like_previews = false;
+	bool generate_shadow = false;
+	bool generate_integrated_shadow = false;
+	bool crop_frames = false;
+	bool deduplicate_frames = false;
+	bool use_render_cache = false;
+	bool single_pass_shadow = false;
+	//the frame schedule of a shot next to its images
+	bool write_schedule = false;
+	std::string render_cache_dir = "render_cache";
+	//the preview background as it looks through the unit palette
+	bool quantize_background = false;
+	dither_mode background_dither = dither_mode::none;
+
+	size_t vpl_threads = 0;
+	bool vpl_cache = false;
+	std::string vpl_cache_dir = "vpl_cache";
+	std::optional<std::array<float, 3>> light_direction;
+	color_metric default_metric = color_metric::redmean;
+	//a trace and a timing table of every shot and every model load next to the images
+	bool profile = false;
+	log_level logging = log_level::info;
+
+	static const config_schema<shot_settings>& schema();
+	//false when any value was invalid, the others are still applied
+	bool load(const config& ini);
+};
@@ -44,6 +44,7 @@ bool vpl::load(const void* data)
 	}
 
 	memcpy_s(_sections.get(), table_size, filecur, table_size);
+	_dirty.assign(_header.section_count, vpl_dirty_range());
 	return true;
 }
 
@@ -57,6 +58,7 @@ void vpl::purge()
 	_header = vplheader();
 	_internal_pal.purge();
 	_sections.reset();
+	_dirty.clear();
 }
 
 file_type vpl::type() const
@@ -83,3 +85,73 @@ byte(*vpl::data() const)[256]
 {
 	return _sections.get();
 }
+
+size_t vpl::section_count() const
+{
+	return is_loaded() ? _header.section_count : 0;
+}
+
+const palette& vpl::internal_palette() const
+{
+	return _internal_pal;
+}
+
+void vpl::write(const size_t section, const size_t start, const byte* values, const size_t count)
+{
+	if (section >= section_count() || start >= 256u || !values)
+		return;
+
+	byte* row = _sections[section];
+	const size_t end = std::min(start + count, (size_t)256u);
+	size_t first = end, last = start;
+	for (size_t i = start; i < end; i++)
+	{
+		if (row[i] != values[i - start])
+		{
+			row[i] = values[i - start];
+			first = std::min(first, i);
+			last = i + 1u;
+		}
+	}
+
+	mark_dirty(section, first, last);
+}
+
+void vpl::mark_dirty(const size_t section, const size_t begin, const size_t end)
+{
+	if (section >= _dirty.size() || end <= begin)
+		return;
+
+	auto& range = _dirty[section];
+	if (range.empty())
+	{
+		range.begin = static_cast<uint32_t>(begin);
+		range.end = static_cast<uint32_t>(std::min(end, (size_t)256u));
+	}
+	else
+	{
+		range.begin = std::min(range.begin, static_cast<uint32_t>(begin));
+		range.end = std::max(range.end, static_cast<uint32_t>(std::min(end, (size_t)256u)));
+	}
+}
+
+void vpl::mark_all_dirty()
+{
+	for (auto& range : _dirty)
+		range = { 0u,256u };
+}
+
+void vpl::clear_dirty()
+{
+	std::fill(_dirty.begin(), _dirty.end(), vpl_dirty_range());
+}
+
+bool vpl::is_dirty() const
+{
+	return std::any_of(_dirty.begin(), _dirty.end(), [](const vpl_dirty_range& range) { return !range.empty(); });
+}
+
+const std::vector<vpl_dirty_range>& vpl::dirty_ranges() const
+{
+	return _dirty;
+}
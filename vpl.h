@@ -11,6 +11,15 @@ struct vplheader
 	uint32_t _reserved{ 0 };
 };
 
+//changed columns of one section
+struct vpl_dirty_range
+{
+	uint32_t begin{ 0 };
+	uint32_t end{ 0 };
+
+	bool empty() const { return end <= begin; }
+};
+
 class vpl : public game_file
 {
 
@@ -29,9 +38,23 @@ public:
 	bool save(const std::filesystem::path path);
 
 	byte(*data() const)[256];
+	size_t section_count() const;
+	//the palette stored in the file
+	const palette& internal_palette() const;
+
+	//copies a part of a section row, only the values that really change are marked dirty
+	void write(const size_t section, const size_t start, const byte* values, const size_t count);
+	//for edits made through data()
+	void mark_dirty(const size_t section, const size_t begin, const size_t end);
+	void mark_all_dirty();
+	void clear_dirty();
+	bool is_dirty() const;
+	//one range per section
+	const std::vector<vpl_dirty_range>& dirty_ranges() const;
 
 private:
 	vplheader _header;
+	std::vector<vpl_dirty_range> _dirty;
 	palette _internal_pal;
 	std::shared_ptr<byte[][256]> _sections;
 };
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "vpl_analysis.h"
+#include "log.h"
+
+#include <bit>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define ANALYSIS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	using luma_row = std::array<int16_t, 256>;
+
+	luma_row row_luma(const byte* row, const int16_t* entry_luma)
+	{
+		luma_row result = {};
+		for (size_t i = 0; i < result.size(); i++)
+			result[i] = entry_luma[row[i]];
+		return result;
+	}
+
+	//cells of two 256 byte rows that differ
+	size_t count_differences(const byte* first, const byte* second)
+	{
+		size_t count = 0;
+#ifdef ANALYSIS_SSE2
+		for (size_t i = 0; i < 256u; i += 16u)
+		{
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + i));
+			const uint32_t equal = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+			count += 16u - std::popcount(equal);
+		}
+#else
+		for (size_t i = 0; i < 256u; i++)
+			count += first[i] != second[i];
+#endif
+		return count;
+	}
+
+	//columns where upper is below lower, and the largest drop
+	void count_drops(const luma_row& lower, const luma_row& upper, size_t& columns, int& worst)
+	{
+		columns = 0;
+		worst = 0;
+		//column 0 is never drawn
+#ifdef ANALYSIS_SSE2
+		__m128i max_drop = _mm_setzero_si128();
+		for (size_t i = 0; i < 256u; i += 8u)
+		{
+			__m128i drop = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&lower[i])),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(&upper[i])));
+			if (!i)
+				drop = _mm_insert_epi16(drop, 0, 0);
+
+			const uint32_t darker = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi16(drop, _mm_setzero_si128())));
+			columns += std::popcount(darker) / 2u;
+			max_drop = _mm_max_epi16(max_drop, drop);
+		}
+
+		alignas(16) int16_t lanes[8] = { 0 };
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), max_drop);
+		worst = *std::max_element(std::begin(lanes), std::end(lanes));
+#else
+		for (size_t i = 1; i < 256u; i++)
+		{
+			const int drop = lower[i] - upper[i];
+			if (drop > 0)
+			{
+				columns++;
+				worst = std::max(worst, drop);
+			}
+		}
+#endif
+	}
+
+	int max_abs_difference(const luma_row& first, const luma_row& second)
+	{
+		int result = 0;
+#ifdef ANALYSIS_SSE2
+		__m128i max_delta = _mm_setzero_si128();
+		for (size_t i = 0; i < 256u; i += 8u)
+		{
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&first[i]));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&second[i]));
+			max_delta = _mm_max_epi16(max_delta, _mm_sub_epi16(_mm_max_epi16(a, b), _mm_min_epi16(a, b)));
+		}
+
+		alignas(16) int16_t lanes[8] = { 0 };
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), max_delta);
+		result = *std::max_element(std::begin(lanes), std::end(lanes));
+#else
+		for (size_t i = 0; i < 256u; i++)
+			result = std::max(result, std::abs(first[i] - second[i]));
+#endif
+		return result;
+	}
+
+	luma_row palette_luma(const palette& pal)
+	{
+		luma_row result = {};
+		for (size_t i = 0; i < result.size(); i++)
+			result[i] = static_cast<int16_t>(vpl_analysis::luma(pal.entry()[i]));
+		return result;
+	}
+}
+
+bool vpl_analysis::report::clean() const
+{
+	return !non_monotonic_sections && !duplicate_sections && unused_entries.empty() && overlaps.empty();
+}
+
+int vpl_analysis::luma(const color& entry)
+{
+	//rec. 601 weights in eighths
+	return (entry.r * 2 + entry.g * 5 + entry.b) / 8;
+}
+
+vpl_analysis::report vpl_analysis::analyze(const vpl& table, const palette& pal, const std::vector<colorset_desc>& sets)
+{
+	report result;
+	const size_t sections = table.section_count();
+	if (!sections)
+		return result;
+
+	const auto entry_luma = palette_luma(pal);
+	result.sections.resize(sections);
+
+	bool referenced[256] = { false };
+	luma_row previous = {};
+	for (size_t s = 0; s < sections; s++)
+	{
+		const byte* row = table.data()[s];
+		section_report& section = result.sections[s];
+
+		for (size_t i = 1; i < 256u; i++)
+			referenced[row[i]] = true;
+
+		const luma_row current = row_luma(row, entry_luma.data());
+		if (s)
+		{
+			count_drops(previous, current, section.darker_columns, section.worst_drop);
+			if (section.darker_columns)
+				result.non_monotonic_sections++;
+		}
+		previous = current;
+
+		section.duplicate_of = s;
+		for (size_t other = 0; other < s; other++)
+		{
+			if (!count_differences(row, table.data()[other]))
+			{
+				section.duplicate_of = other;
+				result.duplicate_sections++;
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 1; i < 256u; i++)
+	{
+		if (!referenced[i])
+			result.unused_entries.push_back(static_cast<byte>(i));
+	}
+
+	for (size_t first = 0; first < sets.size(); first++)
+	{
+		for (size_t second = first + 1; second < sets.size(); second++)
+		{
+			const size_t begin = std::max(sets[first].start, sets[second].start);
+			const size_t end = std::min(sets[first].end, sets[second].end);
+			if (begin < end)
+				result.overlaps.push_back({ first,second,begin,end });
+		}
+	}
+
+	return result;
+}
+
+bool vpl_analysis::compare(const vpl& first, const vpl& second, const palette& pal, difference& result)
+{
+	result = difference();
+	const size_t sections = first.section_count();
+	if (!sections || sections != second.section_count())
+		return false;
+
+	const auto entry_luma = palette_luma(pal);
+	result.cells.resize(sections);
+	for (size_t s = 0; s < sections; s++)
+	{
+		const byte* a = first.data()[s];
+		const byte* b = second.data()[s];
+
+		result.cells[s] = count_differences(a, b);
+		result.total += result.cells[s];
+		if (result.cells[s])
+			result.max_luma_delta = std::max(result.max_luma_delta, max_abs_difference(row_luma(a, entry_luma.data()), row_luma(b, entry_luma.data())));
+	}
+
+	return true;
+}
+
+void vpl_analysis::log_report(const std::string& name, const report& result)
+{
+	for (size_t s = 0; s < result.sections.size(); s++)
+	{
+		const section_report& section = result.sections[s];
+		if (section.darker_columns)
+			LOG(WARNING) << name << ": section " << s << " is darker than section " << s - 1 << " in " << section.darker_columns
+				<< " columns, by up to " << section.worst_drop << ".\n";
+		if (section.duplicate_of != s)
+			LOG(WARNING) << name << ": section " << s << " repeats section " << section.duplicate_of << ".\n";
+	}
+
+	if (!result.unused_entries.empty())
+	{
+		std::string entries;
+		for (const byte entry : result.unused_entries)
+			entries.append(entries.empty() ? "" : ",").append(std::to_string(entry));
+		LOG(WARNING) << name << ": " << result.unused_entries.size() << " palette entries are never used (" << entries << ").\n";
+	}
+
+	for (const auto& overlap : result.overlaps)
+		LOG(WARNING) << name << ": color sets " << overlap.first << " and " << overlap.second << " both write columns "
+			<< overlap.begin << " to " << overlap.end - 1 << ".\n";
+}
+
+size_t vpl_analysis::validate_directory(const std::filesystem::path& directory)
+{
+	std::error_code error;
+	if (!std::filesystem::is_directory(directory, error))
+	{
+		LOG(ERROR) << "Cannot validate " << directory.string() << ", not a directory.\n";
+		return 0;
+	}
+
+	size_t with_findings = 0, checked = 0;
+	for (const auto& file : std::filesystem::recursive_directory_iterator(directory, error))
+	{
+		std::string extension = file.path().extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](const char c) { return static_cast<char>(tolower(c)); });
+		if (!file.is_regular_file() || extension != ".vpl")
+			continue;
+
+		vpl table;
+		if (!table.load(file.path().string()))
+		{
+			LOG(ERROR) << "Failed to load " << file.path().string() << ".\n";
+			with_findings++;
+			continue;
+		}
+
+		checked++;
+		const report result = analyze(table, table.internal_palette());
+		if (!result.clean())
+		{
+			log_report(file.path().filename().string(), result);
+			with_findings++;
+		}
+	}
+
+	LOG(INFO) << checked << " vpl files checked under " << directory.string() << ", " << with_findings << " with findings.\n";
+	return with_findings;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "vpl_generator.h"
+
+//checks for vpl and palette pairs, every table is a few kilobytes so a whole mod folder takes one short pass
+//sections are expected to get brighter with their index, as the generator builds them
+namespace vpl_analysis
+{
+	struct section_report
+	{
+		//columns darker than the same column one section below
+		size_t darker_columns{ 0 };
+		//largest of those drops in luma
+		int worst_drop{ 0 };
+		//first section holding the same row, the section itself when there is none
+		size_t duplicate_of{ 0 };
+	};
+
+	//two color sets writing the same columns, the later set wins there
+	struct set_overlap
+	{
+		size_t first{ 0 }, second{ 0 };
+		size_t begin{ 0 }, end{ 0 };
+	};
+
+	struct report
+	{
+		std::vector<section_report> sections;
+		size_t non_monotonic_sections{ 0 };
+		size_t duplicate_sections{ 0 };
+		//entries 1 to 255 no cell refers to
+		std::vector<byte> unused_entries;
+		std::vector<set_overlap> overlaps;
+
+		bool clean() const;
+	};
+
+	struct difference
+	{
+		//differing cells per section
+		std::vector<size_t> cells;
+		size_t total{ 0 };
+		//largest luma change between the two tables under the palette
+		int max_luma_delta{ 0 };
+	};
+
+	//0 to 255
+	int luma(const color& entry);
+
+	report analyze(const vpl& table, const palette& pal, const std::vector<colorset_desc>& sets = {});
+	//false when either is not loaded or the section counts differ
+	bool compare(const vpl& first, const vpl& second, const palette& pal, difference& result);
+
+	//findings of a report as log lines, nothing for a clean one
+	void log_report(const std::string& name, const report& result);
+	//every .vpl under the directory against its own palette, returns how many have findings
+	size_t validate_directory(const std::filesystem::path& directory);
+}
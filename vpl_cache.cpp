@@ -0,0 +1,33 @@
+#include "vpl_cache.h"
+
+vpl_cache::vpl_cache() :blob_store("VPLTBL01", ".vpltable", "vpl cache")
+{
+}
+
+bool vpl_cache::fetch(const hash128& key, std::vector<byte>& table, const size_t size) const
+{
+	return blob_store::fetch(key, [&table, size](std::istream& input) {
+		uint64_t stored_size = 0;
+		input.read(reinterpret_cast<char*>(&stored_size), sizeof stored_size);
+		if (!input || stored_size != size)
+			return false;
+
+		std::vector<byte> data(size);
+		input.read(reinterpret_cast<char*>(data.data()), data.size());
+		if (static_cast<size_t>(input.gcount()) != size)
+			return false;
+
+		table = std::move(data);
+		return true;
+	});
+}
+
+bool vpl_cache::store(const hash128& key, const std::vector<byte>& table) const
+{
+	return !table.empty() && blob_store::store(key, [&table](std::ostream& output) {
+		const uint64_t size = table.size();
+		output.write(reinterpret_cast<const char*>(&size), sizeof size);
+		output.write(reinterpret_cast<const char*>(table.data()), table.size());
+		return static_cast<bool>(output);
+	});
+}
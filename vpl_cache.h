@@ -0,0 +1,15 @@
+#pragma once
+
+#include "blob_store.h"
+
+//generated vpl tables on disk, the file name is the digest of the palette and the color sets
+class vpl_cache : public blob_store
+{
+public:
+	vpl_cache();
+	~vpl_cache() = default;
+
+	//the entry must hold exactly size bytes
+	bool fetch(const hash128& key, std::vector<byte>& table, const size_t size) const;
+	bool store(const hash128& key, const std::vector<byte>& table) const;
+};
@@ -0,0 +1,287 @@
+#include "vpl_generator.h"
+#include "parallel.h"
+
+void colorset_desc::parse_ini(const std::string_view keyname, const config::value_type& values)
+{
+	name = keyname;
+	size_t remained_paras = values.size();
+
+	//start
+	if (remained_paras > 0u) {
+		start = config::to_int(values[0]);
+		start = std::clamp(start, (size_t)1u, (size_t)255u);
+		remained_paras--;
+	}
+
+	//end
+	if (remained_paras > 0u) {
+		end = config::to_int(values[1]);
+		end = std::clamp(end, (size_t)1u, (size_t)255u);
+		remained_paras--;
+	}
+
+	if (end <= start)
+		std::swap(end, start);
+
+	//self restricted
+	if (remained_paras > 0u) {
+		std::fill_n(color_selection.begin(), color_selection.size(), false);
+
+		char first = toupper(values[2][0]);
+		if (first == 'Y' || first == '1' || first == 'T')
+			std::fill_n(color_selection.begin() + start, end - start + 1u, true);
+		else
+			std::fill_n(color_selection.begin() + 1u, 255u, true);
+
+		remained_paras--;
+	}
+
+	//ambient
+	if (remained_paras > 0u) {
+		ambient = config::to_double(values[3]);
+		remained_paras--;
+	}
+
+	//diffuse
+	if (remained_paras > 0u) {
+		diffuse = config::to_double(values[4]);
+		remained_paras--;
+	}
+
+	//specular
+	if (remained_paras > 0u) {
+		specular = config::to_double(values[5]);
+		remained_paras--;
+	}
+
+	//color selection
+	size_t starting_idx = 6u, para_idx = 0u;
+	if (remained_paras > 0u) {
+		std::fill_n(color_selection.begin(), color_selection.size(), false);
+	}
+
+	while (remained_paras > 0u) {
+		const auto& value = values[starting_idx + para_idx];
+		if (value != "0")
+			color_selection[para_idx] = true;
+
+		remained_paras--;
+		para_idx++;
+	}
+	color_selection[0] = false;
+}
+
+void vpl_generator::set_thread_count(const size_t count)
+{
+	_thread_count = count;
+}
+
+size_t vpl_generator::thread_count() const
+{
+	if (_thread_count)
+		return _thread_count;
+
+	return hardware_thread_count();
+}
+
+bool vpl_generator::generate(vpl& target, const palette& pal, const colorset_desc& set)
+{
+	return generate(target, pal, std::vector<colorset_desc>{ set });
+}
+
+bool vpl_generator::generate(vpl& target, const palette& pal, const std::vector<colorset_desc>& sets)
+{
+	if (!target.is_loaded() || !pal.is_loaded())
+	{
+		LOG(ERROR) << "VPL generation needs a loaded vpl and palette.\n";
+		return false;
+	}
+
+	_generation++;
+
+	//engines first, sets sharing a selection and a metric share one
+	std::vector<size_t> pending;
+	std::vector<size_t> set_engines(sets.size());
+	for (size_t i = 0; i < sets.size(); i++)
+		set_engines[i] = engine_for(pal, sets[i].color_selection, sets[i].metric, pending);
+
+	for (const auto engine_idx : pending)
+		_engines[engine_idx].build_id = ++_builds;
+
+	parallel_for(pending.size(), thread_count(), [&](const size_t task) {
+		auto& entry = _engines[pending[task]];
+		entry.engine.build(pal, entry.selection, entry.metric);
+	});
+
+	//rows are kept per task slot, a different layout starts over
+	const size_t sections = target.section_count();
+	const size_t task_count = sets.size() * sections;
+	if (_row_keys.size() != task_count)
+	{
+		_row_keys.assign(task_count, row_key());
+		_rows.assign(task_count * 256u, 0);
+	}
+
+	//every task fills one section row of one set in its own buffer
+	parallel_for(task_count, thread_count(), [&](const size_t task) {
+		const size_t set_idx = task / sections;
+		const size_t section_idx = task - set_idx * sections;
+		const auto& set = sets[set_idx];
+		const auto& entry = _engines[set_engines[set_idx]];
+		const double effector = curve(set, section_idx);
+
+		const row_key key = { entry.build_id,set.start,set.end,effector };
+		if (_row_keys[task] == key)
+			return;
+
+		_row_keys[task] = key;
+		const auto& engine = entry.engine;
+		byte* row = &_rows[task * 256u];
+
+		for (size_t i = set.start; i < set.end; i++)
+		{
+			const auto& orig_color = pal.entry()[i];
+			color target_color =
+			{
+				static_cast<byte>(std::clamp(orig_color.r * effector,0.0,255.0)),
+				static_cast<byte>(std::clamp(orig_color.g * effector,0.0,255.0)),
+				static_cast<byte>(std::clamp(orig_color.b * effector,0.0,255.0)),
+			};
+
+			row[i] = engine.find(target_color);
+		}
+	});
+
+	merge_rows(target, sets);
+
+	//drop the engines idle for the longest time
+	if (_engines.size() > sets.size() + max_idle_engines)
+	{
+		std::sort(_engines.begin(), _engines.end(), [](const engine_entry& l, const engine_entry& r) {
+			return l.last_use > r.last_use;
+		});
+		_engines.resize(sets.size() + max_idle_engines);
+	}
+
+	return true;
+}
+
+bool vpl_generator::generate_cached(vpl& target, const palette& pal, const std::vector<colorset_desc>& sets)
+{
+	if (!_cache.valid() || !target.is_loaded() || !pal.is_loaded())
+		return generate(target, pal, sets);
+
+	const size_t sections = target.section_count();
+	const size_t task_count = sets.size() * sections;
+	const hash128 key = digest(pal, sets, sections);
+
+	std::vector<byte> rows;
+	if (_cache.fetch(key, rows, task_count * 256u))
+	{
+		//the engines behind cached rows are unknown, the next run computes them again
+		_rows = std::move(rows);
+		_row_keys.assign(task_count, row_key());
+		merge_rows(target, sets);
+		return true;
+	}
+
+	if (!generate(target, pal, sets))
+		return false;
+
+	_cache.store(key, _rows);
+	return true;
+}
+
+bool vpl_generator::open_cache(const std::filesystem::path& directory)
+{
+	return _cache.open(directory);
+}
+
+void vpl_generator::close_cache()
+{
+	_cache.close();
+}
+
+hash128 vpl_generator::digest(const palette& pal, const std::vector<colorset_desc>& sets, const size_t sections)
+{
+	//bump when the generated values change for the same inputs
+	static constexpr const uint32_t generator_version = 1u;
+
+	hash_builder inputs;
+	inputs.append(generator_version)
+		.append(pal.entry(), sizeof(color[256]))
+		.append(sections)
+		.append(sets.size());
+
+	for (const auto& set : sets)
+	{
+		byte selection[256] = { 0 };
+		for (size_t i = 0; i < std::min(set.color_selection.size(), (size_t)256u); i++)
+			selection[i] = set.color_selection[i];
+
+		inputs.append(set.start)
+			.append(set.end)
+			.append(set.ambient)
+			.append(set.diffuse)
+			.append(set.specular)
+			.append(set.metric)
+			.append(selection);
+	}
+
+	return inputs.finish();
+}
+
+double vpl_generator::curve(const colorset_desc& set, const size_t section_idx)
+{
+	double f = section_idx / 16.0;
+
+	double spec = set.specular;
+	double ambient = set.ambient;
+	double diffuse = set.diffuse;
+
+	return f < 1.0 ? (ambient + f * diffuse) : (ambient + diffuse + (f - 1.0) * (diffuse + spec));
+}
+
+void vpl_generator::merge_rows(vpl& target, const std::vector<colorset_desc>& sets) const
+{
+	//overlaps are resolved before writing, the vpl only sees the final values
+	const size_t sections = target.section_count();
+	byte merged[256] = { 0 };
+	for (size_t section_idx = 0; section_idx < sections; section_idx++)
+	{
+		memcpy(merged, target.data()[section_idx], sizeof merged);
+		for (size_t set_idx = 0; set_idx < sets.size(); set_idx++)
+		{
+			const auto& set = sets[set_idx];
+			if (set.end <= set.start)
+				continue;
+
+			const byte* row = &_rows[(set_idx * sections + section_idx) * 256u];
+			memcpy(&merged[set.start], &row[set.start], set.end - set.start);
+		}
+
+		target.write(section_idx, 0, merged, sizeof merged);
+	}
+}
+
+size_t vpl_generator::engine_for(const palette& pal, const std::vector<bool>& selection, const color_metric metric, std::vector<size_t>& pending)
+{
+	for (size_t i = 0; i < _engines.size(); i++)
+	{
+		auto& entry = _engines[i];
+		const bool planned = std::find(pending.begin(), pending.end(), i) != pending.end();
+		if (planned ? (entry.selection == selection && entry.metric == metric) : entry.engine.built_for(pal, selection, metric))
+		{
+			entry.last_use = _generation;
+			return i;
+		}
+	}
+
+	engine_entry entry;
+	entry.selection = selection;
+	entry.metric = metric;
+	entry.last_use = _generation;
+	_engines.push_back(std::move(entry));
+	pending.push_back(_engines.size() - 1u);
+	return _engines.size() - 1u;
+}
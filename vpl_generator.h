@@ -0,0 +1,86 @@
+#pragma once
+
+#include "vpl.h"
+#include "config.h"
+#include "nearest_color.h"
+#include "vpl_cache.h"
+
+struct colorset_desc
+{
+	std::string name = "Default";
+	size_t start = 1, end = 255;
+	bool self_restricted = false;
+	std::vector<bool> color_selection = std::vector<bool>(256u, true);
+	float ambient = 0.6f, diffuse = 0.8f, specular = 1.2f;
+	color_metric metric = color_metric::redmean;
+
+	colorset_desc() {
+		color_selection[0] = false;
+	}
+
+	void parse_ini(const std::string_view keyname, const config::value_type& values);
+};
+
+//computes vpl sections from color sets, every section of every set is an independent task
+//results are merged in set order afterwards so the bytes do not depend on the thread count
+//a row whose inputs did not change since the last run is reused, only changed cells reach the vpl
+class vpl_generator
+{
+public:
+	vpl_generator() = default;
+	~vpl_generator() = default;
+
+	//0 uses every hardware thread
+	void set_thread_count(const size_t count);
+	size_t thread_count() const;
+
+	//rewrites the [start, end) range of every section with the nearest colors of one set
+	bool generate(vpl& target, const palette& pal, const colorset_desc& set);
+	//all sets at once, where ranges overlap the later set wins
+	bool generate(vpl& target, const palette& pal, const std::vector<colorset_desc>& sets);
+	//same as above, a configuration generated before is read from the disk cache when it is open
+	bool generate_cached(vpl& target, const palette& pal, const std::vector<colorset_desc>& sets);
+
+	bool open_cache(const std::filesystem::path& directory);
+	void close_cache();
+	//every input of generate, the vpl contents outside the set ranges are not part of it
+	static hash128 digest(const palette& pal, const std::vector<colorset_desc>& sets, const size_t sections);
+
+	//lighting factor of a section
+	static double curve(const colorset_desc& set, const size_t section_idx);
+
+private:
+	//an engine built for the selection and metric, new ones are built by the caller
+	size_t engine_for(const palette& pal, const std::vector<bool>& selection, const color_metric metric, std::vector<size_t>& pending);
+	//writes the set ranges of the kept rows to the vpl
+	void merge_rows(vpl& target, const std::vector<colorset_desc>& sets) const;
+
+	static constexpr const size_t max_idle_engines = 16u;
+
+	struct engine_entry
+	{
+		nearest_color engine;
+		std::vector<bool> selection;
+		color_metric metric{ color_metric::redmean };
+		uint64_t last_use{ 0 };
+		uint64_t build_id{ 0 };
+	};
+
+	//inputs of a row of the last run
+	struct row_key
+	{
+		uint64_t build_id{ 0 };
+		size_t start{ 0 }, end{ 0 };
+		double effector{ 0.0 };
+
+		bool operator==(const row_key& r) const = default;
+	};
+
+	size_t _thread_count = 0;
+	uint64_t _generation = 0;
+	uint64_t _builds = 0;
+	std::vector<engine_entry> _engines;
+	std::vector<row_key> _row_keys;
+	std::vector<byte> _rows;
+	vpl_cache _cache;
+};
@@ -1,4 +1,5 @@
 #include "vxl.h"
+#include "profiler.h"
 
 vxl::vxl(const std::string& filename) :vxl()
 {
@@ -7,6 +8,7 @@ vxl::vxl(const std::string& filename) :vxl()
 
 bool vxl::load(const std::string& filename)
 {
+	PROFILE_SCOPE("vxl::load");
 	auto data = read_whole_file(filename);
 	return load(data.get());
 }
@@ -18,6 +20,8 @@ bool vxl::load(const void* data)
 		return false;
 	}
 
+	PROFILE_SCOPE("vxl::decode");
+
 	purge();
 
 	byte* floating_cur = reinterpret_cast<byte*>(const_cast<void*>(data));